@@ -0,0 +1,6006 @@
+#define _POSIX_C_SOURCE 200809L // Expose POSIX functions such as clock_gettime under strict C modes
+
+#include <stdio.h>    // For standard input/output functions like fopen, fprintf
+#include <stdlib.h>   // For memory allocation functions like malloc, free
+#include <string.h>   // For string manipulation functions like strcpy, strcmp, strlen
+#include <math.h>     // For exp2() when decaying sketched search counts
+#include <fcntl.h>    // For open() when mapping the snapshot file
+#include <unistd.h>   // For close()
+#include <sys/mman.h> // For mmap/munmap to query the snapshot in place
+#include <sys/stat.h> // For stat() to compare file modification times
+#include <pthread.h>  // For reader threads and the writer lock in concurrency mode
+#include <time.h>     // For clock_gettime() when measuring throughput
+#include <sched.h>    // For sched_yield() while the writer waits for readers
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // For the SSE2/AVX2 intrinsics of the dictionary text scanner
+#define HAVE_X86_SIMD 1
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+#include "autosuggest.h"
+
+// --- MACRO DEFINITIONS ---
+
+#define BYTE_VALUES 256        // Number of distinct bytes a word may contain (any UTF-8 byte)
+#define CHILD_MASK_WORDS (BYTE_VALUES / 64) // 64-bit words in the child presence mask of a Trie node
+#define SOLE_CHILD_TAG 1       // Low bit of a node's children pointer marking its only child, stored without a child array
+#define JOURNAL_SYNC_BATCH 32  // Number of journal records written between fsync calls
+#define PERSIST_BATCH 256      // Queued writes (or words with unsaved searches) that make the write-behind thread flush at once
+#define PERSIST_INTERVAL_MS 100 // Longest time a queued write waits for the write-behind thread
+#define STATS_INITIAL_CAPACITY 1024 // Initial number of slots in the search statistics hash table
+#define GRAM_TABLE_INITIAL_CAPACITY 4096 // Initial number of slots in the trigram table of the substring index
+#define WORD_BLOCK_SIZE 65536  // Bytes of word text per storage block of the substring index
+#define INDEX_COMPACT_MIN 1024 // Deleted words the substring index keeps before compacting (once they are also a quarter of its ids)
+#define PREFIX_CACHE_BUCKETS 1024 // Hash buckets of the prefix result cache (a power of two)
+#define PREFIX_CACHE_ENTRIES 512 // Most completion lists the prefix result cache holds
+#define PREFIX_CACHE_ENTRY_SHARE 8 // Largest share of the cache's byte budget (1/N) one completion list may take
+#define FNV_OFFSET_BASIS 14695981039346656037ULL // Starting value of the FNV-1a hash
+#define FNV_PRIME 1099511628211ULL // Multiplier of the FNV-1a hash
+#define SKETCH_DEPTH 4         // Rows (hash functions) of the Count-Min Sketch
+#define SKETCH_WIDTH 4096      // Counters per sketch row (a power of two); estimates exceed the truth by ~e/SKETCH_WIDTH of all searches
+#define SKETCH_HEAVY_HITTERS 64 // Words tracked by the Space-Saving list of the most searched words
+#define SKETCH_RESCALE 64      // Half-lives after which the scaled sketch counts are brought back to the current time
+#define SKETCH_MAGIC "TRIESKT1" // Identifies a sketch state file (exactly 8 bytes)
+#define SKETCH_VERSION 1       // Bumped whenever the sketch file layout changes
+#define WRITE_BUFFER_SIZE 65536 // Size of the stdio buffer used when rewriting the dictionary file
+
+#define HISTOGRAM_SUB_BITS 4         // Leading bits kept per histogram bucket (relative error below 1/16)
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS) // Covers every uint64_t value
+
+// Counts heap allocations made by the word stores, so benchmarks can report allocations per operation
+#define COUNT_ALLOCATION() __atomic_fetch_add(&allocationCount, 1, __ATOMIC_RELAXED)
+
+// Instrumentation hooks; they compile to nothing when ENABLE_METRICS is 0
+#if ENABLE_METRICS
+#define METRIC_START(start) uint64_t start = nowNanoseconds()
+#define METRIC_STOP(id, start) recordMetric((id), nowNanoseconds() - (start))
+#define METRIC_COUNT(counter) ((counter)++)
+#define METRIC_QUERY_BEGIN() (queryNodes = queryWords = 0)
+#define METRIC_QUERY_END() finishQuery()
+#else
+#define METRIC_START(start) ((void)0)
+#define METRIC_STOP(id, start) ((void)0)
+#define METRIC_COUNT(counter) ((void)0)
+#define METRIC_QUERY_BEGIN() ((void)0)
+#define METRIC_QUERY_END() ((void)0)
+#endif
+
+// Atomic accessors for Trie fields that lock-free readers load while a writer changes them
+#define LOAD_ACQUIRE(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#define NODE_SLAB_SIZE 4096    // Number of Trie nodes carved out of each slab allocation
+#define SNAPSHOT_MAGIC "TRIESNP1"       // Identifies a snapshot file (exactly 8 bytes)
+#define SNAPSHOT_VERSION 3              // Bumped whenever the snapshot layout or contents change
+#define LOAD_CHUNK_SIZE (1 << 20)       // Bytes requested per fread call by the parallel dictionary loader
+#define SNAP_PAD(n) (((n) + 3) & ~3)    // Rounds a label count up so the offsets that follow stay 4-byte aligned
+#define DA_TERMINAL 0x80000000u         // Bit of a double-array base marking that a word ends at the cell
+#define DA_FREE UINT32_MAX              // Check value of a double-array cell that belongs to no node
+#define DA_NONE UINT32_MAX              // Returned when a double-array node does not exist
+#define DA_MAX_TRIES 16                 // Failed placements after which a free cell stops being tried as a first child
+#define DA_REBUILD_UPDATES 1024         // Updates after which the next query recompiles a dropped double array
+#define DA_REBUILD_IDLE_MS 500          // Quiet time after the last update after which the next query recompiles it
+
+// --- DATA STRUCTURES ---
+
+// Children of a Trie node: a presence bit for every byte plus the existing children packed in byte order.
+// A child's slot is the number of set bits below its byte, so the array only holds real children.
+typedef struct
+{
+    uint64_t mask[CHILD_MASK_WORDS];      // Bit b is set if there is a child for byte b
+    unsigned char rank[CHILD_MASK_WORDS]; // Children before each mask word (slot of its first set bit)
+    uint16_t count;                       // Number of children
+    uint16_t capacity;                    // Slots allocated in children
+    struct TrieNode *children[];          // The children, ordered by edge byte
+} ChildArray;
+
+// Structure for a single node in the Trie data structure
+struct TrieNode
+{
+    union
+    {
+        ChildArray *children;      // Children of the node, NULL if it has none, or its only child tagged with SOLE_CHILD_TAG
+        struct TrieNode *nextFree; // Next node of the pool's free list while the node is unused
+    };
+    bool isEndOfWord;              // Flag to mark if a node represents the end of a complete word
+    unsigned char topCount;        // Number of entries in topWords
+    unsigned char soleByte;        // Edge byte of the only child while children holds it directly
+    uint32_t wordCount;            // Number of words in this subtree, including the one ending here
+    WordInfo *info;                // The word ending at this node (NULL unless isEndOfWord)
+    WordInfo *topWords[TOP_K];     // Best-ranked words in this subtree, best first
+};
+
+// A slab is one large block of Trie nodes obtained with a single malloc call
+typedef struct NodeSlab
+{
+    struct NodeSlab *next;          // The previously allocated slab (slabs form a linked list)
+    int used;                       // How many nodes of this slab have been handed out
+    TrieNode nodes[NODE_SLAB_SIZE]; // Storage for the nodes handed out by createNode()
+} NodeSlab;
+
+// Arena that owns every Trie node, so the whole Trie can be released in one go
+typedef struct
+{
+    NodeSlab *slabs;    // Linked list of all slabs, newest first
+    TrieNode *freeList; // Nodes released by deletions, chained through nextFree for reuse
+} NodePool;
+
+// State of one fuzzy (typo-tolerant) search over the Trie
+typedef struct
+{
+    uint32_t query[MAX_WORD_LEN]; // The prefix that was typed, decoded to code points
+    int queryLen;                 // Its length in code points
+    int maxDistance;              // Largest edit distance accepted
+    FuzzyMatch matches[TOP_K];    // Best matches so far, closest first, then most searched
+    int count;                    // Number of entries in matches
+} FuzzySearch;
+
+// What the instrumentation measures: latencies of the hot paths and file I/O, then per-query counts
+typedef enum
+{
+    METRIC_AUTOSUGGEST,    // A prefix query with all its completions (menu or batch "suggest")
+    METRIC_SEARCH_PREFIX,  // Walking down to the node of a prefix, in any engine
+    METRIC_INSERT,         // Inserting one word
+    METRIC_DELETE,         // Deleting one word
+    METRIC_LOAD,           // Loading the dictionary file and replaying the journal
+    METRIC_JOURNAL_WRITE,  // Appending one journal record
+    METRIC_COMPACT,        // Rewriting the dictionary file
+    METRIC_STATS_FILE,     // Loading or saving the search statistics file
+    METRIC_NODES_VISITED,  // Nodes visited by one query
+    METRIC_WORDS_EMITTED,  // Words returned by one query
+    METRIC_COUNT           // Number of metrics
+} MetricId;
+
+// HDR-style histogram: log-linear buckets give every value the same relative precision
+typedef struct
+{
+    uint64_t count;                      // Number of recorded values
+    uint64_t sum;                        // Sum of the recorded values (for the mean)
+    uint64_t max;                        // Largest recorded value
+    uint64_t buckets[HISTOGRAM_BUCKETS]; // Number of values per bucket (see histogramBucket)
+} Histogram;
+
+// Number of stored words of every length, so the shortest and longest lengths need no traversal
+typedef struct
+{
+    uint32_t counts[MAX_WORD_LEN]; // counts[n] is the number of words that are n characters long
+} LengthIndex;
+
+// State of one enumeration of the words of a single length (see emitWordsOfLength)
+typedef struct
+{
+    int length;                // Length of the words wanted, in characters
+    long remaining;            // Words of that length not found yet; the walk stops when it reaches 0
+    WordSink sink;             // Called with every word found
+    void *context;             // Passed to the sink unchanged
+    char buffer[MAX_WORD_LEN]; // The word along the current path
+} LengthWalk;
+
+// Offsets of the dictionary lines that start with one letter
+typedef struct
+{
+    size_t *offsets; // Offset of each line in the loaded text
+    size_t count;    // Number of lines
+    size_t capacity; // Allocated size of offsets
+} LineList;
+
+// Receives every line found by the text scanner, already terminated and with its ASCII letters lowercased
+typedef void (*LineHandler)(char *line, bool ascii, void *context);
+
+// State of one scan that splits dictionary text into lines in place
+typedef struct
+{
+    char *text;          // The text being scanned
+    size_t lineStart;    // Offset of the line being scanned
+    bool nonAscii;       // Whether that line has a byte >= 0x80 so far (it then needs the UTF-8 folding)
+    LineHandler handler; // Called with every line that can be loaded
+    void *context;       // Passed to the handler unchanged
+} LineScan;
+
+struct ParallelLoad;
+
+// One thread of the parallel dictionary loader
+typedef struct
+{
+    struct ParallelLoad *load;        // State shared by all workers
+    size_t start, end;                // Byte range of the text this worker splits into lines
+    LineList buckets[BYTE_VALUES];    // Lines of that range, grouped by first byte
+    NodePool pool;                    // Private node pool for the subtrees this worker builds
+    LengthIndex lengths;              // Lengths of the words this worker inserted
+    bool threaded;                    // Whether the current phase runs on its own thread (otherwise it ran inline)
+} LoadWorker;
+
+// Shared state of a parallel dictionary load
+typedef struct ParallelLoad
+{
+    TrieNode *root;              // The Trie being loaded
+    char *text;                  // The whole dictionary file, split into C strings in place
+    LoadWorker *workers;         // The worker threads
+    int workerCount;             // Number of workers
+    int nextSubtree;             // Next entry of order to hand out (atomic)
+    int order[BYTE_VALUES];      // First bytes sorted by number of lines, largest first
+    int subtreeCount;            // Number of first bytes in order that have any lines
+    TrieNode *subtrees[BYTE_VALUES]; // Finished subtree for each first byte, attached by the main thread
+} ParallelLoad;
+
+// Structure for a node of the path-compressed radix tree (Patricia trie) engine
+typedef struct RadixNode
+{
+    struct RadixNode **children; // Child nodes, sorted by the first byte of their edge labels
+    int childCount;              // Number of children currently stored
+    int childCapacity;           // Allocated size of the children array
+    int labelLen;                // Length of the edge label leading into this node
+    bool isEndOfWord;            // Flag to mark if the path ending here is a complete word
+    char label[];                // Edge label bytes (not null-terminated), allocated with the node
+} RadixNode;
+
+// Header at the start of a snapshot file
+typedef struct
+{
+    char magic[8];       // Always SNAPSHOT_MAGIC
+    uint32_t version;    // Always SNAPSHOT_VERSION
+    uint32_t rootOffset; // File offset of the root node
+    uint64_t fileSize;   // Total size of the file, used to detect truncation
+    LengthIndex lengths; // Number of words of every length, so length queries need no traversal
+} SnapHeader;
+
+// A node inside the snapshot. It is followed by childCount label bytes (padded to a multiple
+// of 4) and then childCount uint32 offsets of the children. Nodes refer to each other only
+// by file offsets, so the file can be mapped at any address and used as-is.
+typedef struct
+{
+    uint16_t childCount; // Number of outgoing edges
+    uint8_t isEndOfWord; // Non-zero if the path ending here is a complete word
+    uint8_t reserved;    // Padding, always 0
+} SnapNode;
+
+// The currently mapped snapshot
+typedef struct
+{
+    const unsigned char *base; // Start of the mapping, or NULL when no snapshot is open
+    size_t size;               // Length of the mapping in bytes
+    uint32_t rootOffset;       // Offset of the root node
+} Snapshot;
+
+// One cell of the double-array trie. The child of node s for byte c is cell base(s) + c,
+// and it really is a child of s only if its check is s.
+typedef struct
+{
+    uint32_t base;  // Offset of the children (DA_TERMINAL is set if a word ends here)
+    uint32_t check; // Index of the parent cell, or DA_FREE
+} DaCell;
+
+// Child links of a double-array cell, so completions visit the children without probing every byte
+typedef struct
+{
+    unsigned char firstChild;  // Byte of the first child, or 0 if there is none
+    unsigned char nextSibling; // Byte of the next child of the same parent, or 0 if there is none
+} DaLinks;
+
+// The double-array trie compiled from the pointer Trie
+typedef struct
+{
+    DaCell *cells;   // The BASE/CHECK pairs (NULL when no double array is built)
+    DaLinks *links;  // Child links, parallel to cells
+    uint32_t size;   // Number of cells; every base + 255 is below it, so lookups need no bounds check
+    int droppedUpdates;  // Updates that changed the Trie since the double array was dropped
+    uint64_t lastUpdate; // nowNanoseconds() of the last of them
+} DoubleArray;
+
+// Free cells of a double array under construction, in a circular doubly-linked list
+typedef struct
+{
+    int32_t *next, *prev;  // List links, indexed by cell
+    unsigned char *tries;  // Failed placements per cell (DA_MAX_TRIES = no longer in the list)
+    int32_t head;          // A cell in the list, or -1 if the list is empty
+    uint32_t count;        // Number of cells in the list
+    uint32_t used;         // One past the highest cell in use
+} DaBuilder;
+
+// Open-addressing hash table holding all search statistics
+typedef struct
+{
+    WordFrequency *slots; // Slot array (capacity is a power of two)
+    size_t capacity;      // Number of slots
+    size_t count;         // Number of occupied slots
+    char **unsaved;       // Words with unsaved searches, in the order they got their first one
+    size_t unsavedCount;  // Number of entries in unsaved
+    size_t unsavedCapacity; // Size of the unsaved array
+    uint64_t unsavedSince; // nowNanoseconds() when the first of them was searched
+} FrequencyTable;
+
+// One word of the Space-Saving list; its counts are scaled like the sketch counters
+typedef struct
+{
+    char word[MAX_WORD_LEN]; // The searched word/prefix
+    uint64_t hash;           // hashWord(word), compared before the strings
+    double count;            // Scaled search count (too high by at most error)
+    double error;            // Scaled count of the entry this one replaced
+} HeavyHitter;
+
+// Search statistics in fixed memory. A search at time t is added with weight 2^((t - landmark) / half-life)
+// (forward decay), so stored counts never need aging: dividing by the weight of "now" gives the decayed count.
+typedef struct
+{
+    double counters[SKETCH_DEPTH][SKETCH_WIDTH]; // Count-Min Sketch of the scaled counts of every search
+    HeavyHitter heavy[SKETCH_HEAVY_HITTERS];     // Space-Saving list of the most searched words
+    int heavyCount;                              // Entries of heavy in use
+    double landmark;                             // Unix time at which a search weighs 1 (0 until the first search)
+} SearchSketch;
+
+// Header of the sketch state file, followed by the counters and then heavyCount heavy-hitter
+// records (a length byte, the word, and its count and error). Counts are stored decayed to savedAt.
+typedef struct
+{
+    char magic[8];       // Always SKETCH_MAGIC
+    uint32_t version;    // Always SKETCH_VERSION
+    uint32_t depth;      // SKETCH_DEPTH of the program that wrote the file
+    uint32_t width;      // SKETCH_WIDTH of the program that wrote the file
+    uint32_t heavyCount; // Number of heavy-hitter records
+    double savedAt;      // Unix time the counts were decayed to
+} SketchHeader;
+
+// Global table of search frequencies, loaded from and saved to STATS_FILE
+static FrequencyTable searchStats = {NULL, 0, 0, NULL, 0, 0, 0};
+
+// Streaming search statistics (STATS_SKETCH), and the list topSearches() hands out in that mode
+static StatsMode statsMode = STATS_EXACT;
+static double sketchHalfLife = SKETCH_HALF_LIFE;
+static SearchSketch searchSketch;
+static WordFrequency sketchTop[SKETCH_HEAVY_HITTERS];
+
+// Per-reader epoch slot, padded to a cache line so readers do not slow each other down
+typedef struct
+{
+    _Alignas(64) uint64_t epoch; // Epoch the reader entered at, or 0 while it is outside the Trie
+} ReaderSlot;
+
+// An object unlinked by the writer that may still be in use by a reader
+typedef struct
+{
+    void *object;   // The Trie node or word record
+    bool isNode;    // true for a Trie node, false for a WordInfo
+    uint64_t epoch; // Epoch at which it was retired
+} RetiredObject;
+
+// Growable list of objects waiting to be reclaimed (touched by the writer only)
+typedef struct
+{
+    RetiredObject *items;
+    size_t count;
+    size_t capacity;
+} RetireList;
+
+// Work description for one reader thread of the concurrency stress run
+typedef struct
+{
+    TrieNode *root;       // The shared Trie
+    const char **words;   // Words to look up
+    int wordCount;        // Number of words
+    int *stop;            // Set to non-zero by the writer when the run is over
+    long long operations; // Lookups performed (written when the thread finishes)
+    long long errors;     // Lookups that missed a word that was never deleted
+    long long completions; // Words returned by the prefix completions
+} ReaderTask;
+
+// Ids of the indexed words containing one trigram (or one byte or byte pair), in increasing order
+typedef struct
+{
+    uint32_t gram;     // The trigram's three bytes, packed (0 marks an empty slot: words hold no NUL byte; unused for bytes and pairs)
+    uint32_t count;    // Ids in the list
+    uint32_t capacity; // Ids the array has room for
+    uint32_t *ids;
+} PostingList;
+
+// Block of word text of the substring index, filled one word after another
+typedef struct WordBlock
+{
+    struct WordBlock *next;     // The previously allocated block
+    size_t used;                // Bytes handed out
+    char text[WORD_BLOCK_SIZE];
+} WordBlock;
+
+// Trigram inverted index over the dictionary, answering substring (infix) queries; single bytes and byte
+// pairs get posting lists too, so fragments shorter than a trigram are narrowed down the same way
+typedef struct
+{
+    bool built;             // Whether the index holds the dictionary (insertions and deletions are ignored until then)
+    bool deferPostings;     // While loading, new words are only stored; postPendingWords() indexes them in one pass
+    uint32_t postedCount;   // Ids whose trigrams are in the posting lists (the others wait for postPendingWords)
+    char **words;           // Word of each id, NULL once deleted (ids only grow, so posting lists stay sorted)
+    WordBlock *blocks;      // Storage of the words, newest block first (a deleted word's bytes stay until the next compaction)
+    uint32_t wordCount;     // Ids handed out so far
+    uint32_t deletedCount;  // Ids whose word was deleted; they stay in the posting lists until the next compaction
+    uint32_t wordCapacity;  // Entries the words array has room for
+    PostingList *unigrams;  // Posting list of every byte, indexed by the byte (BYTE_VALUES lists)
+    PostingList *bigrams;   // Posting list of every byte pair, indexed by first << 8 | second (BYTE_VALUES^2 lists)
+    PostingList *grams;     // Open-addressing table of posting lists, one per trigram
+    size_t gramCapacity;    // Slots in the table (a power of two)
+    size_t gramCount;       // Occupied slots
+} SubstringIndex;
+
+// Completion list of one prefix, materialized by the prefix result cache
+typedef struct PrefixCacheEntry
+{
+    struct PrefixCacheEntry *chain; // Next entry in the same hash bucket
+    struct PrefixCacheEntry *newer; // Neighbour towards the most recently used end of the LRU list
+    struct PrefixCacheEntry *older; // Neighbour towards the least recently used end
+    uint64_t hash;                  // hashWord(prefix)
+    char *words;                    // The completions in alphabetical order, each NUL-terminated
+    size_t size;                    // Bytes of words in use
+    long count;                     // Number of completions
+    size_t bytes;                   // Memory the entry holds, counted against the cache's budget
+    char prefix[];                  // The prefix, allocated together with the entry
+} PrefixCacheEntry;
+
+// Bounded LRU cache of completion lists, keyed by prefix
+typedef struct
+{
+    PrefixCacheEntry *buckets[PREFIX_CACHE_BUCKETS]; // Hash chains
+    PrefixCacheEntry *newest;                        // Most recently used entry
+    PrefixCacheEntry *oldest;                        // Least recently used entry (evicted first)
+    int entries;                                     // Entries cached
+    size_t bytes;                                    // Memory held by all entries
+    long hits, misses;                               // Queries answered from the cache / by walking the word store
+    long invalidations, evictions;                   // Entries dropped because a word changed / to make room
+} PrefixCache;
+
+// A completion list being materialized for the prefix result cache while it is answered
+typedef struct
+{
+    WordSink sink;   // The caller's sink
+    void *context;   // The caller's context
+    char *words;     // The completions so far, each NUL-terminated
+    size_t size;     // Bytes in use
+    size_t capacity; // Bytes allocated
+    long count;      // Completions so far
+    bool overflow;   // The list outgrew what the cache admits (it is answered but not kept)
+} CacheFill;
+
+// A dictionary mutation or search count delta waiting for the write-behind thread
+typedef struct PendingWrite
+{
+    struct PendingWrite *next; // The write queued after this one
+    uint64_t sequence;         // Position in the queue, so sorting keeps the order of writes to one word
+    char op;                   // '+' for an added word, '-' for a deleted one
+    char word[];               // The word, allocated together with the record
+} PendingWrite;
+
+// Queue between the thread that changes the dictionary or search counts and the write-behind thread
+typedef struct
+{
+    pthread_mutex_t lock;   // Guards every field below except running
+    pthread_cond_t wake;    // Wakes the write-behind thread (first write queued, batch full, drain or stop)
+    pthread_cond_t flushed; // Signaled each time a batch is on disk
+    pthread_t thread;
+    bool running;           // Started and not stopped (only the thread that starts and stops it reads this)
+    bool stopping;          // The thread should write everything out and exit
+    bool urgent;            // A caller waits in drainPersistence: flush without waiting for the interval
+    long failures;          // Batches that could not be written (persistenceFailures() reports them)
+    PendingWrite *head;     // Oldest queued journal record
+    PendingWrite **tail;    // Where the next record is linked
+    char *statsLines;       // Search count lines ("word delta") handed over by handOffSearchCounts, or NULL
+    size_t statsLength;     // Bytes in statsLines
+    int count;              // Writes in the queue (journal records, plus one if statsLines is set)
+    uint64_t firstQueuedAt; // nowNanoseconds() when the oldest queued write was added
+    uint64_t queued;        // Writes queued since the thread started
+    uint64_t written;       // Writes taken off the queue and written out since the thread started
+} WriteBehind;
+
+// Concurrency mode state: readers never lock; the writer serializes on writerLock and frees
+// unlinked nodes only after every reader has moved to a later epoch
+static bool concurrentMode = false;
+static uint64_t globalEpoch = 1;
+static ReaderSlot readerSlots[MAX_READERS];
+static int readerCount = 0;
+static RetireList retireList = {NULL, 0, 0};
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Mutation journal: open handle (NULL until the first write), records in the file and records not yet synced
+static FILE *journal = NULL;
+static int journalRecords = 0;
+static int journalUnsynced = 0;
+
+// Write-behind persistence: while running, its thread owns the journal and appends to the stats file
+static WriteBehind writeBehind = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// The engine chosen on the command line, and the radix tree root when that engine is in use
+static Engine activeEngine = ENGINE_TRIE;
+static RadixNode *radixRoot = NULL;
+static Snapshot snapshot = {NULL, 0, 0};
+static DoubleArray doubleArray = {NULL, NULL, 0, 0, 0};
+
+// Trigram index for substring queries (built by loadDictionary or the first substring query)
+static SubstringIndex substringIndex = {0};
+static bool substringIndexing = true;
+
+// Materialized completion lists of recent prefixes, and the memory they may hold (0 turns the cache off)
+static PrefixCache prefixCache = {0};
+static size_t prefixCacheLimit = (size_t)PREFIX_CACHE_MB << 20;
+
+// Global node pool backing the Trie, and the pool createNode() draws from on the calling thread
+static NodePool nodePool = {NULL, NULL};
+static _Thread_local NodePool *activePool = &nodePool;
+
+// Words per length in the Trie or radix tree, and the index insertAt() updates on the calling thread
+static LengthIndex wordLengths = {{0}};
+static _Thread_local LengthIndex *activeLengths = &wordLengths;
+
+// Threads used to load the dictionary file into the Trie (1 = load on the main thread)
+static int loadThreads = 1;
+
+// Text scanner requested for loading the dictionary (SCAN_AUTO picks the widest the CPU supports)
+static TextScanner textScanner = SCAN_AUTO;
+static const char *textScannerNames[] = {"auto", "scalar", "sse2", "avx2"};
+
+#if ENABLE_METRICS
+// Histograms of the instrumented operations, and the counters of the query running on this thread
+static Histogram metrics[METRIC_COUNT];
+static const char *metricNames[METRIC_COUNT] = {"autoSuggest", "searchPrefix", "insert", "deleteWord", "loadDictionary",
+                                         "journalWrite", "compactDictionary", "statsFile", "nodesVisited", "wordsEmitted"};
+static _Thread_local uint64_t queryNodes = 0;
+static _Thread_local uint64_t queryWords = 0;
+#endif
+
+// Number of heap allocations made by the Trie, radix tree and statistics (see COUNT_ALLOCATION)
+static unsigned long long allocationCount = 0;
+
+// --- INSTRUMENTATION FUNCTIONS ---
+
+/**
+ * @brief Reads a monotonic clock.
+ * @return The current time in nanoseconds.
+ */
+uint64_t nowNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#if ENABLE_METRICS
+
+/**
+ * @brief Returns the histogram bucket of a value.
+ * Values below HISTOGRAM_SUB_BUCKETS get a bucket each; larger values share a bucket with every
+ * value that has the same leading bits, so each power of two is split into HISTOGRAM_SUB_BUCKETS
+ * buckets and the relative error stays below 1/HISTOGRAM_SUB_BUCKETS at any magnitude.
+ * @param value The recorded value.
+ * @return The bucket index (below HISTOGRAM_BUCKETS).
+ */
+static int histogramBucket(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return (int)value;
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS; // Bits below the kept leading bits
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (int)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief Returns the smallest value that falls into a histogram bucket.
+ * @param bucket The bucket index.
+ * @return The lower bound of the bucket.
+ */
+static uint64_t histogramBucketValue(int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    return (uint64_t)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+}
+
+/**
+ * @brief Adds one value to a metric's histogram.
+ * Uses relaxed atomics only, so lock-free reader threads can record without locking.
+ * @param id The metric.
+ * @param value The value (a latency in nanoseconds or a per-query count).
+ */
+static void recordMetric(MetricId id, uint64_t value)
+{
+    Histogram *histogram = &metrics[id];
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->buckets[histogramBucket(value)], 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&histogram->max, &max, value, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ; // max is refreshed by the failed exchange
+}
+
+/**
+ * @brief Records the nodes visited and words emitted by the query that just finished.
+ */
+static void finishQuery()
+{
+    recordMetric(METRIC_NODES_VISITED, queryNodes);
+    recordMetric(METRIC_WORDS_EMITTED, queryWords);
+}
+
+/**
+ * @brief Returns a percentile of a histogram.
+ * @param histogram The histogram.
+ * @param fraction The percentile as a fraction (0.5 for the median).
+ * @return The lower bound of the bucket holding that percentile (0 if nothing was recorded).
+ */
+static uint64_t histogramPercentile(const Histogram *histogram, double fraction)
+{
+    uint64_t rank = (uint64_t)(fraction * histogram->count);
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen > rank)
+            return histogramBucketValue(i);
+    }
+    return histogram->max;
+}
+
+/**
+ * @brief Formats one line of the metrics dump as "<name> <value>", the layout of the stats file.
+ * @param index The line number, starting at 0.
+ * @param line Buffer that receives the line.
+ * @param size The size of the buffer.
+ * @return false when index is past the last line.
+ */
+bool metricLine(int index, char *line, size_t size)
+{
+    static const char *fields[] = {"count", "mean", "p50", "p90", "p99", "p999", "max"};
+    static const double fractions[] = {0, 0, 0.5, 0.9, 0.99, 0.999, 0};
+    int fieldCount = sizeof(fields) / sizeof(fields[0]);
+    if (index >= METRIC_COUNT * fieldCount)
+        return false;
+
+    MetricId id = (MetricId)(index / fieldCount);
+    int field = index % fieldCount;
+    const Histogram *histogram = &metrics[id];
+    uint64_t value;
+    if (field == 0)
+        value = histogram->count;
+    else if (field == 1)
+        value = histogram->count ? histogram->sum / histogram->count : 0;
+    else if (field == fieldCount - 1)
+        value = histogram->max;
+    else
+        value = histogramPercentile(histogram, fractions[field]);
+    // Latencies are in nanoseconds; the per-query counts have no unit
+    const char *unit = field && id < METRIC_NODES_VISITED ? "_ns" : "";
+    snprintf(line, size, "%s.%s%s %llu", metricNames[id], fields[field], unit, (unsigned long long)value);
+    return true;
+}
+
+#endif
+
+/**
+ * @brief Starts timing a prefix query made by the caller (the METRIC_AUTOSUGGEST latency).
+ * Also resets the node and word counters of the calling thread's query.
+ * @return The start time to pass to endQuery() (0 when the metrics are compiled out).
+ */
+uint64_t beginQuery()
+{
+#if ENABLE_METRICS
+    METRIC_QUERY_BEGIN();
+    return nowNanoseconds();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Records the latency, nodes visited and words emitted of a query started by beginQuery().
+ * @param start The value beginQuery() returned.
+ */
+void endQuery(uint64_t start)
+{
+    METRIC_STOP(METRIC_AUTOSUGGEST, start);
+    (void)start; // Unused when the metrics are compiled out
+    METRIC_QUERY_END();
+}
+
+// --- NODE POOL FUNCTIONS ---
+
+/**
+ * @brief Takes one uninitialized node from a pool, reusing freed nodes first.
+ * @param pool The pool to allocate from.
+ * @return A pointer to the node, or NULL if a new slab could not be allocated.
+ */
+static TrieNode *poolAlloc(NodePool *pool)
+{
+    // Reuse a node released by an earlier deletion if there is one
+    if (pool->freeList)
+    {
+        TrieNode *node = pool->freeList;
+        pool->freeList = node->nextFree; // Unlink the node from the front of the free list
+        return node;
+    }
+    // The newest slab is missing or exhausted, so grab a fresh one
+    if (!pool->slabs || pool->slabs->used == NODE_SLAB_SIZE)
+    {
+        NodeSlab *slab = (NodeSlab *)malloc(sizeof(NodeSlab));
+        if (!slab)
+            return NULL;
+        COUNT_ALLOCATION();
+        slab->next = pool->slabs; // Push the slab onto the pool's chain
+        slab->used = 0;
+        pool->slabs = slab;
+    }
+    // Hand out the next unused node of the newest slab
+    return &pool->slabs->nodes[pool->slabs->used++];
+}
+
+/**
+ * @brief Returns a node to its pool so a later createNode() can reuse it.
+ * @param pool The pool that owns the node.
+ * @param node The node to release.
+ */
+static void poolFree(NodePool *pool, TrieNode *node)
+{
+    node->nextFree = pool->freeList; // Link the node in front of the free list
+    pool->freeList = node;
+}
+
+/**
+ * @brief Frees every slab of a pool at once, invalidating all nodes it handed out.
+ * @param pool The pool to release.
+ */
+static void poolRelease(NodePool *pool)
+{
+    while (pool->slabs)
+    {
+        NodeSlab *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    // Reset the pool so it can be used again for a new Trie
+    pool->freeList = NULL;
+}
+
+/**
+ * @brief Moves every slab and free node of one pool into another.
+ * Used to hand the nodes built by a loader thread over to the global pool.
+ * @param pool The pool that takes ownership.
+ * @param other The pool to empty.
+ */
+static void mergePool(NodePool *pool, NodePool *other)
+{
+    // Append the current chains to the end of the other pool's chains, keeping a partly
+    // used slab of the receiving pool at the front so it is filled first
+    NodeSlab **slabTail = &other->slabs;
+    while (*slabTail)
+        slabTail = &(*slabTail)->next;
+    if (pool->slabs)
+    {
+        *slabTail = pool->slabs->next;
+        pool->slabs->next = other->slabs;
+    }
+    else
+        pool->slabs = other->slabs;
+    TrieNode **freeTail = &other->freeList;
+    while (*freeTail)
+        freeTail = &(*freeTail)->nextFree;
+    *freeTail = pool->freeList;
+    pool->freeList = other->freeList;
+    other->slabs = NULL;
+    other->freeList = NULL;
+}
+
+// --- SEARCH STATISTICS FUNCTIONS ---
+
+/**
+ * @brief Hashes a word with the 64-bit FNV-1a function.
+ * @param word The word to hash.
+ * @return The hash value.
+ */
+static uint64_t hashWord(const char *word)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    while (*word)
+    {
+        hash ^= (unsigned char)*word++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds the slot of a word in the statistics table (linear probing).
+ * @param word The word to look for.
+ * @param hash The word's hash value.
+ * @return The slot holding the word, or the empty slot where it would be inserted.
+ */
+static WordFrequency *findStatsSlot(const char *word, uint64_t hash)
+{
+    size_t mask = searchStats.capacity - 1; // The capacity is always a power of two
+    size_t i = hash & mask;
+    while (searchStats.slots[i].word)
+    {
+        if (searchStats.slots[i].hash == hash && strcmp(searchStats.slots[i].word, word) == 0)
+            return &searchStats.slots[i];
+        i = (i + 1) & mask; // Probe the next slot
+    }
+    return &searchStats.slots[i];
+}
+
+/**
+ * @brief Doubles the capacity of the statistics table and re-inserts every entry.
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool growStatsTable()
+{
+    size_t oldCapacity = searchStats.capacity;
+    WordFrequency *oldSlots = searchStats.slots;
+    size_t newCapacity = oldCapacity ? oldCapacity * 2 : STATS_INITIAL_CAPACITY;
+
+    WordFrequency *slots = (WordFrequency *)calloc(newCapacity, sizeof(WordFrequency));
+    if (!slots)
+        return false;
+    COUNT_ALLOCATION();
+    searchStats.slots = slots;
+    searchStats.capacity = newCapacity;
+
+    // Move every entry to its slot in the bigger table (the stored hash avoids rehashing)
+    for (size_t i = 0; i < oldCapacity; i++)
+        if (oldSlots[i].word)
+            *findStatsSlot(oldSlots[i].word, oldSlots[i].hash) = oldSlots[i];
+    free(oldSlots);
+    return true;
+}
+
+/**
+ * @brief Records that a word has searches the write-behind thread has not been handed yet.
+ * @param slot The word's entry, whose unsaved count just became non-zero.
+ */
+static void markUnsavedSearches(WordFrequency *slot)
+{
+    if (searchStats.unsavedCount == searchStats.unsavedCapacity)
+    {
+        size_t capacity = searchStats.unsavedCapacity ? searchStats.unsavedCapacity * 2 : PERSIST_BATCH;
+        char **grown = (char **)realloc(searchStats.unsaved, capacity * sizeof(char *));
+        if (!grown)
+        {
+            slot->unsaved = 0; // Only lost until the next saveSearchStats, which writes every total
+            return;
+        }
+        searchStats.unsaved = grown;
+        searchStats.unsavedCapacity = capacity;
+    }
+    if (searchStats.unsavedCount == 0)
+        searchStats.unsavedSince = nowNanoseconds();
+    searchStats.unsaved[searchStats.unsavedCount++] = slot->word; // Entry strings never move
+}
+
+/**
+ * @brief Adds to the search count of a word, creating its entry if needed.
+ * With write-behind running, the searches are also counted as unsaved, so the thread can later
+ * append one line per word instead of one per search.
+ * @param word The searched word/prefix.
+ * @param amount How much to add to its count.
+ * @return The new search count, or 0 if memory could not be allocated.
+ */
+static int addSearchCount(const char *word, int amount)
+{
+    // Keep the load factor below 3/4 so probe sequences stay short
+    if ((searchStats.count + 1) * 4 > searchStats.capacity * 3 && !growStatsTable())
+        return 0;
+
+    uint64_t hash = hashWord(word);
+    WordFrequency *slot = findStatsSlot(word, hash);
+    if (!slot->word)
+    {
+        // First search of this word: claim the empty slot
+        slot->word = (char *)malloc(strlen(word) + 1);
+        if (!slot->word)
+            return 0;
+        COUNT_ALLOCATION();
+        strcpy(slot->word, word);
+        slot->hash = hash;
+        slot->frequency = 0;
+        slot->unsaved = 0;
+        searchStats.count++;
+    }
+    slot->frequency += amount;
+    if (writeBehind.running && (slot->unsaved += amount) == amount)
+        markUnsavedSearches(slot);
+    return slot->frequency;
+}
+
+/**
+ * @brief Frees every entry of the statistics table and empties the sketch.
+ */
+void freeSearchStats()
+{
+    for (size_t i = 0; i < searchStats.capacity; i++)
+        free(searchStats.slots[i].word);
+    free(searchStats.slots);
+    free(searchStats.unsaved);
+    searchStats = (FrequencyTable){NULL, 0, 0, NULL, 0, 0, 0};
+    memset(&searchSketch, 0, sizeof(searchSketch)); // Fixed memory, so emptying it is all there is to do
+}
+
+// --- SEARCH SKETCH FUNCTIONS ---
+
+/**
+ * @brief Returns the wall-clock time that sketched searches are weighted by.
+ * Wall-clock time (not a monotonic clock), since the counts keep decaying between runs.
+ * @return Seconds since the Unix epoch.
+ */
+static double sketchClock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Returns the weight a search made at a given time is added with.
+ * @param now The time of the search.
+ * @return 2^((now - landmark) / half-life); dividing a scaled count by it gives the decayed count.
+ */
+static double sketchWeight(double now)
+{
+    return exp2((now - searchSketch.landmark) / sketchHalfLife);
+}
+
+/**
+ * @brief Decays every count to a given time and makes that time the new landmark.
+ * Keeps the weights of new searches from growing without bound. The ranking weights of the Trie's
+ * words are scaled too, so they stay comparable with each other and with the sketch.
+ * @param now The new landmark.
+ */
+static void rescaleSketch(double now)
+{
+    double scale = 1.0 / sketchWeight(now);
+    for (int row = 0; row < SKETCH_DEPTH; row++)
+        for (int i = 0; i < SKETCH_WIDTH; i++)
+            searchSketch.counters[row][i] *= scale;
+    for (int i = 0; i < searchSketch.heavyCount; i++)
+    {
+        searchSketch.heavy[i].count *= scale;
+        searchSketch.heavy[i].error *= scale;
+    }
+    // Every word record hangs off a pool node (released nodes have no record)
+    for (NodeSlab *slab = nodePool.slabs; slab; slab = slab->next)
+        for (int i = 0; i < slab->used; i++)
+            if (slab->nodes[i].info)
+                slab->nodes[i].info->weight *= scale;
+    searchSketch.landmark = now;
+}
+
+/**
+ * @brief Computes the counter a hash maps to in one sketch row.
+ * The rows use h1 + row * h2 from the two halves of the 64-bit hash, which is as good as
+ * independent hash functions for a Count-Min Sketch.
+ * @param hash hashWord() of the word.
+ * @param row The sketch row.
+ * @return The counter's index within the row.
+ */
+static uint32_t sketchColumn(uint64_t hash, int row)
+{
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    return (h1 + row * h2) & (SKETCH_WIDTH - 1);
+}
+
+/**
+ * @brief Estimates the scaled count of a word: the smallest of its counters.
+ * @param hash hashWord() of the word.
+ * @return The estimate, never below the true scaled count.
+ */
+static double sketchEstimate(uint64_t hash)
+{
+    double estimate = searchSketch.counters[0][sketchColumn(hash, 0)];
+    for (int row = 1; row < SKETCH_DEPTH; row++)
+    {
+        double counter = searchSketch.counters[row][sketchColumn(hash, row)];
+        if (counter < estimate)
+            estimate = counter;
+    }
+    return estimate;
+}
+
+/**
+ * @brief Adds a scaled amount to a word in the Space-Saving list.
+ * A word that is not listed replaces the entry with the smallest count and inherits that count
+ * as its error, so every listed count is an upper bound and no heavy hitter can be missed.
+ * @param word The searched word/prefix.
+ * @param hash hashWord() of the word.
+ * @param amount The scaled amount to add.
+ */
+static void offerHeavyHitter(const char *word, uint64_t hash, double amount)
+{
+    HeavyHitter *smallest = NULL;
+    for (int i = 0; i < searchSketch.heavyCount; i++)
+    {
+        HeavyHitter *entry = &searchSketch.heavy[i];
+        if (entry->hash == hash && strcmp(entry->word, word) == 0)
+        {
+            entry->count += amount;
+            return;
+        }
+        if (!smallest || entry->count < smallest->count)
+            smallest = entry;
+    }
+    HeavyHitter *entry;
+    if (searchSketch.heavyCount < SKETCH_HEAVY_HITTERS)
+    {
+        entry = &searchSketch.heavy[searchSketch.heavyCount++];
+        entry->count = entry->error = 0;
+    }
+    else
+    {
+        entry = smallest;
+        entry->error = entry->count;
+    }
+    snprintf(entry->word, sizeof(entry->word), "%s", word);
+    entry->hash = hash;
+    entry->count += amount;
+}
+
+/**
+ * @brief Records one search in the sketch.
+ * Uses the conservative update: only the counters below the new estimate are raised, which
+ * keeps the overestimate of rarely searched words much smaller than a plain increment.
+ * @param word The searched word/prefix.
+ * @return The decayed search count of the word, rounded (at least 1).
+ */
+static int sketchAddSearch(const char *word)
+{
+    double now = sketchClock();
+    if (searchSketch.landmark == 0 || now - searchSketch.landmark > SKETCH_RESCALE * sketchHalfLife)
+    {
+        if (searchSketch.landmark == 0)
+            searchSketch.landmark = now; // First search: nothing to decay yet
+        rescaleSketch(now);
+    }
+    double weight = sketchWeight(now);
+    uint64_t hash = hashWord(word);
+    double estimate = sketchEstimate(hash) + weight;
+    for (int row = 0; row < SKETCH_DEPTH; row++)
+    {
+        double *counter = &searchSketch.counters[row][sketchColumn(hash, row)];
+        if (*counter < estimate)
+            *counter = estimate;
+    }
+    offerHeavyHitter(word, hash, weight);
+    return (int)(estimate / weight + 0.5);
+}
+
+/**
+ * @brief Returns the decayed search count the sketch estimates for a word.
+ * @param word The word/prefix to look up.
+ * @return The rounded estimate, 0 if the word was (almost) never searched.
+ */
+static int sketchSearchCount(const char *word)
+{
+    if (searchSketch.landmark == 0)
+        return 0; // Nothing was ever searched
+    return (int)(sketchEstimate(hashWord(word)) / sketchWeight(sketchClock()) + 0.5);
+}
+
+/**
+ * @brief Lists the Space-Saving words with their decayed counts, for topSearches().
+ * A listed count is the smaller of the Space-Saving and sketch bounds; words whose count has
+ * decayed to 0 are left out (their word is NULL).
+ * @return The array sketchTop, valid until the next call; its first heavyCount entries are filled in.
+ */
+static WordFrequency *sketchHeavyHitters()
+{
+    double weight = sketchWeight(sketchClock());
+    for (int i = 0; i < searchSketch.heavyCount; i++)
+    {
+        HeavyHitter *entry = &searchSketch.heavy[i];
+        double count = sketchEstimate(entry->hash);
+        if (entry->count < count)
+            count = entry->count;
+        int frequency = (int)(count / weight + 0.5);
+        sketchTop[i] = (WordFrequency){frequency ? entry->word : NULL, entry->hash, frequency, 0};
+    }
+    return sketchTop;
+}
+
+/**
+ * @brief Loads the sketch from SKETCH_FILE, replacing the current state.
+ * A missing file or one written with other sketch dimensions leaves the sketch empty.
+ * @return true if the file was loaded.
+ */
+static bool loadSearchSketch()
+{
+    FILE *file = fopen(SKETCH_FILE, "rb");
+    if (!file)
+        return false;
+    memset(&searchSketch, 0, sizeof(searchSketch));
+
+    SketchHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, SKETCH_MAGIC, 8) == 0 &&
+              header.version == SKETCH_VERSION && header.depth == SKETCH_DEPTH && header.width == SKETCH_WIDTH &&
+              header.heavyCount <= SKETCH_HEAVY_HITTERS &&
+              fread(searchSketch.counters, sizeof(searchSketch.counters), 1, file) == 1;
+    for (uint32_t i = 0; ok && i < header.heavyCount; i++)
+    {
+        HeavyHitter *entry = &searchSketch.heavy[i];
+        int len = fgetc(file);
+        ok = len > 0 && len < MAX_WORD_LEN && fread(entry->word, len, 1, file) == 1 &&
+             fread(&entry->count, sizeof(double), 1, file) == 1 && fread(&entry->error, sizeof(double), 1, file) == 1;
+        entry->word[ok ? len : 0] = '\0';
+        entry->hash = hashWord(entry->word);
+    }
+    fclose(file);
+
+    if (!ok)
+    {
+        memset(&searchSketch, 0, sizeof(searchSketch)); // Start over rather than trust a damaged file
+        return false;
+    }
+    searchSketch.heavyCount = header.heavyCount;
+    searchSketch.landmark = header.savedAt; // The stored counts weigh 1 at the time they were saved
+    return true;
+}
+
+/**
+ * @brief Saves the sketch to SKETCH_FILE, with every count decayed to the current time.
+ * The file is written to a temporary name and renamed into place, so a crash keeps the old state.
+ * @return true on success.
+ */
+static bool saveSearchSketch()
+{
+    if (searchSketch.landmark == 0)
+        return true; // Nothing was ever searched
+    FILE *file = fopen(SKETCH_FILE ".tmp", "wb");
+    if (!file)
+        return false;
+
+    double now = sketchClock();
+    rescaleSketch(now);
+    SketchHeader header = {SKETCH_MAGIC, SKETCH_VERSION, SKETCH_DEPTH, SKETCH_WIDTH, searchSketch.heavyCount, now};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(searchSketch.counters, sizeof(searchSketch.counters), 1, file);
+    for (int i = 0; i < searchSketch.heavyCount; i++)
+    {
+        HeavyHitter *entry = &searchSketch.heavy[i];
+        fputc((int)strlen(entry->word), file);
+        fputs(entry->word, file);
+        fwrite(&entry->count, sizeof(double), 1, file);
+        fwrite(&entry->error, sizeof(double), 1, file);
+    }
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok || rename(SKETCH_FILE ".tmp", SKETCH_FILE) != 0)
+    {
+        remove(SKETCH_FILE ".tmp");
+        return false;
+    }
+    return true;
+}
+
+// --- MOST SEARCHED WORDS ---
+
+/**
+ * @brief Decides whether one search entry ranks above another: more searches first, then alphabetical.
+ * @param a The first entry.
+ * @param b The second entry.
+ * @return true if a should be listed before b.
+ */
+static bool searchRanksHigher(const WordFrequency *a, const WordFrequency *b)
+{
+    if (a->frequency != b->frequency)
+        return a->frequency > b->frequency;
+    return strcmp(a->word, b->word) < 0;
+}
+
+/**
+ * @brief Restores the min-heap property downwards from a position (the worst entry sits on top).
+ * @param heap The heap array.
+ * @param size The number of entries in the heap.
+ * @param i The position to sift down from.
+ */
+static void siftDownSearchHeap(WordFrequency **heap, int size, int i)
+{
+    while (1)
+    {
+        int worst = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < size && searchRanksHigher(heap[worst], heap[left]))
+            worst = left;
+        if (right < size && searchRanksHigher(heap[worst], heap[right]))
+            worst = right;
+        if (worst == i)
+            return;
+        WordFrequency *tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+/**
+ * @brief Finds the n most searched words with a bounded heap, in O(entries * log n).
+ * @param results Array that receives up to n entries, most searched first.
+ * @param n The number of entries wanted.
+ * @return The number of entries written to results.
+ */
+int topSearches(WordFrequency **results, int n)
+{
+    // The table holds every searched word; the sketch only its heavy hitters, with decayed counts
+    WordFrequency *entries = searchStats.slots;
+    size_t entryCount = searchStats.capacity;
+    if (statsMode == STATS_SKETCH)
+    {
+        entries = sketchHeavyHitters();
+        entryCount = searchSketch.heavyCount;
+    }
+    int size = 0;
+    for (size_t i = 0; i < entryCount && n > 0; i++)
+    {
+        WordFrequency *entry = &entries[i];
+        if (!entry->word)
+            continue;
+        if (size < n)
+        {
+            // Still filling the heap: append and sift the new entry up
+            int j = size++;
+            results[j] = entry;
+            while (j > 0 && searchRanksHigher(results[(j - 1) / 2], results[j]))
+            {
+                WordFrequency *tmp = results[j];
+                results[j] = results[(j - 1) / 2];
+                results[(j - 1) / 2] = tmp;
+                j = (j - 1) / 2;
+            }
+        }
+        else if (searchRanksHigher(entry, results[0]))
+        {
+            // Better than the worst entry kept so far: replace it
+            results[0] = entry;
+            siftDownSearchHeap(results, size, 0);
+        }
+    }
+
+    // Repeatedly move the worst entry to the back, which leaves the array sorted best first
+    for (int end = size - 1; end > 0; end--)
+    {
+        WordFrequency *tmp = results[0];
+        results[0] = results[end];
+        results[end] = tmp;
+        siftDownSearchHeap(results, end, 0);
+    }
+    return size;
+}
+
+// --- CONCURRENT READ SUPPORT (EPOCH-BASED RECLAMATION) ---
+
+/**
+ * @brief Registers the calling thread as a lock-free reader.
+ * Slots are handed back all at once by endConcurrentMode().
+ * @return The reader's slot index, or -1 if all MAX_READERS slots are taken.
+ */
+int registerReader()
+{
+    int slot = __atomic_fetch_add(&readerCount, 1, __ATOMIC_RELAXED);
+    return slot < MAX_READERS ? slot : -1;
+}
+
+/**
+ * @brief Marks the start of a read-side critical section (never blocks).
+ * Nodes a reader can reach stay allocated until it calls readerExit().
+ * @param slot The slot returned by registerReader().
+ */
+void readerEnter(int slot)
+{
+    uint64_t epoch = __atomic_load_n(&globalEpoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&readerSlots[slot].epoch, epoch, __ATOMIC_RELAXED);
+    // Publish the epoch before touching the Trie; pairs with the fence in reclaimRetired()
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Marks the end of a read-side critical section.
+ * @param slot The slot returned by registerReader().
+ */
+void readerExit(int slot)
+{
+    __atomic_store_n(&readerSlots[slot].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Frees retired objects that no reader can still be looking at.
+ * An object retired at epoch E is safe once every active reader entered at epoch E or later.
+ * Must be called by the writer only.
+ */
+static void reclaimRetired()
+{
+    // Order the unlinking stores before reading the reader slots; pairs with readerEnter()
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint64_t oldest = UINT64_MAX;
+    int readers = __atomic_load_n(&readerCount, __ATOMIC_RELAXED);
+    if (readers > MAX_READERS)
+        readers = MAX_READERS;
+    for (int i = 0; i < readers; i++)
+    {
+        uint64_t epoch = __atomic_load_n(&readerSlots[i].epoch, __ATOMIC_ACQUIRE);
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+
+    // Free what is safe and compact the rest to the front of the list
+    size_t kept = 0;
+    for (size_t i = 0; i < retireList.count; i++)
+    {
+        RetiredObject *item = &retireList.items[i];
+        if (item->epoch <= oldest)
+        {
+            if (item->isNode)
+                poolFree(&nodePool, (TrieNode *)item->object);
+            else
+                free(item->object);
+        }
+        else
+        {
+            retireList.items[kept++] = *item;
+        }
+    }
+    retireList.count = kept;
+}
+
+/**
+ * @brief Waits until every active reader entered at a given epoch or later.
+ * Readers never block, so this always ends once the readers in older critical sections leave them.
+ * Must be called by the writer only.
+ * @param epoch The epoch the readers must have reached.
+ */
+static void waitForReaders(uint64_t epoch)
+{
+    // Order the unlinking stores before reading the reader slots; pairs with readerEnter()
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int readers = __atomic_load_n(&readerCount, __ATOMIC_RELAXED);
+    if (readers > MAX_READERS)
+        readers = MAX_READERS;
+    for (int i = 0; i < readers; i++)
+    {
+        uint64_t entered;
+        while ((entered = __atomic_load_n(&readerSlots[i].epoch, __ATOMIC_ACQUIRE)) && entered < epoch)
+            sched_yield();
+    }
+}
+
+/**
+ * @brief Schedules an unlinked object to be freed once no reader can still reach it.
+ * If the retire list cannot grow, the writer waits for the readers instead and frees the object at once.
+ * @param object The Trie node or word record to free.
+ * @param isNode true for a Trie node (returned to the pool), false for a malloc'd record.
+ */
+static void retireObject(void *object, bool isNode)
+{
+    // Readers that enter from now on see the new epoch and cannot reach the unlinked object
+    uint64_t epoch = __atomic_add_fetch(&globalEpoch, 1, __ATOMIC_SEQ_CST);
+    if (retireList.count == retireList.capacity)
+    {
+        size_t capacity = retireList.capacity ? retireList.capacity * 2 : 64;
+        RetiredObject *grown = (RetiredObject *)realloc(retireList.items, capacity * sizeof(RetiredObject));
+        if (!grown)
+        {
+            // No room to track the object: reclaim synchronously rather than leak it
+            waitForReaders(epoch);
+            if (isNode)
+                poolFree(&nodePool, (TrieNode *)object);
+            else
+                free(object);
+            reclaimRetired(); // Everything retired earlier is now safe too, which frees up the list
+            return;
+        }
+        retireList.items = grown;
+        retireList.capacity = capacity;
+    }
+    retireList.items[retireList.count++] = (RetiredObject){object, isNode, epoch};
+}
+
+/**
+ * @brief Releases a Trie node that was just unlinked from the Trie.
+ * Outside concurrency mode it goes straight back to the pool; otherwise its reuse is deferred.
+ * @param node The unlinked node.
+ */
+static void releaseNode(TrieNode *node)
+{
+    if (concurrentMode)
+        retireObject(node, true);
+    else
+        poolFree(&nodePool, node);
+}
+
+/**
+ * @brief Releases a word record that is no longer referenced by the Trie.
+ * @param info The word record.
+ */
+static void releaseWordInfo(WordInfo *info)
+{
+    if (concurrentMode)
+        retireObject(info, false);
+    else
+        free(info);
+}
+
+// --- CHILD ACCESS FUNCTIONS ---
+
+/**
+ * @brief Checks whether a child array has a child for a given byte.
+ * @param array The child array.
+ * @param byte The edge byte.
+ * @return true if the byte's presence bit is set.
+ */
+static bool hasChildByte(const ChildArray *array, unsigned char byte)
+{
+    return (array->mask[byte >> 6] >> (byte & 63)) & 1;
+}
+
+/**
+ * @brief Computes the slot of a byte in a child array: the number of children with smaller bytes.
+ * @param array The child array.
+ * @param byte The edge byte (its own bit need not be set).
+ * @return The slot the byte's child has, or would have once inserted.
+ */
+static int childSlot(const ChildArray *array, unsigned char byte)
+{
+    uint64_t below = array->mask[byte >> 6] & ((1ULL << (byte & 63)) - 1);
+    return array->rank[byte >> 6] + __builtin_popcountll(below);
+}
+
+/**
+ * @brief Recomputes the per-word ranks of a child array after its mask changed.
+ * @param array The child array.
+ */
+static void updateChildRanks(ChildArray *array)
+{
+    int total = 0;
+    for (int i = 0; i < CHILD_MASK_WORDS; i++)
+    {
+        array->rank[i] = total;
+        total += __builtin_popcountll(array->mask[i]);
+    }
+}
+
+/**
+ * @brief Tells whether a node's children pointer holds its only child rather than a child array.
+ * Most nodes below the first few levels have a single child, and storing it directly spares
+ * lookups one dependent load and the Trie one allocation per such node.
+ * @param children The value of the children pointer.
+ * @return true if it is a tagged child node.
+ */
+static bool isSoleChild(const ChildArray *children)
+{
+    return (uintptr_t)children & SOLE_CHILD_TAG;
+}
+
+/**
+ * @brief Strips the tag from a children pointer that holds a node's only child.
+ * @param children The tagged pointer.
+ * @return The child node.
+ */
+static TrieNode *soleChild(const ChildArray *children)
+{
+    return (TrieNode *)((uintptr_t)children & ~(uintptr_t)SOLE_CHILD_TAG);
+}
+
+/**
+ * @brief Tags a child node so it can be stored as its parent's only child.
+ * @param child The child node (nodes are aligned, so the low bit is free).
+ * @return The value for the parent's children pointer.
+ */
+static ChildArray *tagSoleChild(TrieNode *child)
+{
+    return (ChildArray *)((uintptr_t)child | SOLE_CHILD_TAG);
+}
+
+/**
+ * @brief Returns the child of a node reached by a given byte.
+ * An only child is compared with its byte directly. Otherwise one bit test decides whether the
+ * child exists and a popcount of the lower bits finds its slot. Safe to call from lock-free readers.
+ * @param node The parent node.
+ * @param byte The edge byte.
+ * @return The child, or NULL if there is none.
+ */
+static TrieNode *getChild(TrieNode *node, unsigned char byte)
+{
+    ChildArray *array = LOAD_ACQUIRE(node->children);
+    if (isSoleChild(array))
+        return node->soleByte == byte ? soleChild(array) : NULL;
+    if (!array || !hasChildByte(array, byte))
+        return NULL;
+    return LOAD_ACQUIRE(array->children[childSlot(array, byte)]);
+}
+
+/**
+ * @brief Sets (or with NULL, removes) the child of a node reached by a given byte.
+ * Outside concurrency mode an only child is stored directly and the child array is changed in
+ * place while it has room. In concurrency mode a changed array is copied, published and the old
+ * copy released, so readers see either the old or the new array but never a half-updated one; a
+ * node only takes the sole-child form outside concurrency mode, so soleByte never changes under a reader.
+ * @param node The parent node.
+ * @param byte The edge byte.
+ * @param child The new child, or NULL to remove the existing one.
+ * @return true on success, false if memory could not be allocated (nothing changes).
+ */
+static bool setChild(TrieNode *node, unsigned char byte, TrieNode *child)
+{
+    ChildArray *old = node->children;
+    if (isSoleChild(old))
+    {
+        if (node->soleByte == byte)
+        {
+            STORE_RELEASE(node->children, child ? tagSoleChild(child) : NULL); // Replaced or removed in one store
+            return true;
+        }
+        if (!child)
+            return true; // Nothing to remove
+
+        // A second child: move both into a child array, in byte order
+        ChildArray *array = (ChildArray *)malloc(sizeof(ChildArray) + 2 * sizeof(TrieNode *));
+        if (!array)
+            return false;
+        COUNT_ALLOCATION();
+        bool after = byte > node->soleByte;
+        memset(array->mask, 0, sizeof(array->mask));
+        array->mask[node->soleByte >> 6] |= 1ULL << (node->soleByte & 63);
+        array->mask[byte >> 6] |= 1ULL << (byte & 63);
+        array->children[!after] = soleChild(old);
+        array->children[after] = child;
+        array->count = array->capacity = 2;
+        updateChildRanks(array);
+        STORE_RELEASE(node->children, array);
+        return true;
+    }
+    if (!old && child && !concurrentMode)
+    {
+        node->soleByte = byte;
+        STORE_RELEASE(node->children, tagSoleChild(child));
+        return true;
+    }
+
+    bool present = old && hasChildByte(old, byte);
+    int pos = old ? childSlot(old, byte) : 0;
+    if (present && child)
+    {
+        STORE_RELEASE(old->children[pos], child); // Replacing a pointer is a single store
+        return true;
+    }
+    if (!present && !child)
+        return true; // Nothing to remove
+
+    int count = old ? old->count : 0;
+    int newCount = present ? count - 1 : count + 1;
+    uint64_t bit = 1ULL << (byte & 63);
+    if (!concurrentMode && present && newCount == 1)
+    {
+        // One child is left: store it directly and drop the array
+        for (int i = 0; i < CHILD_MASK_WORDS; i++)
+        {
+            uint64_t bits = old->mask[i] & ~(i == byte >> 6 ? bit : 0);
+            if (bits)
+                node->soleByte = i * 64 + __builtin_ctzll(bits);
+        }
+        node->children = tagSoleChild(old->children[pos == 0]); // The slot the removed child does not have
+        free(old);
+        return true;
+    }
+    if (!concurrentMode && newCount && old && newCount <= old->capacity)
+    {
+        // No reader can be looking, so shift the later children by one slot in place
+        if (present)
+            memmove(&old->children[pos], &old->children[pos + 1], (count - pos - 1) * sizeof(TrieNode *));
+        else
+        {
+            memmove(&old->children[pos + 1], &old->children[pos], (count - pos) * sizeof(TrieNode *));
+            old->children[pos] = child;
+        }
+        old->mask[byte >> 6] ^= bit;
+        old->count = newCount;
+        updateChildRanks(old);
+        return true;
+    }
+
+    // Build the new array with the child inserted or removed
+    ChildArray *array = NULL;
+    if (newCount)
+    {
+        // Leave room to grow (the next power of two) unless readers force a copy on every change anyway
+        int capacity = newCount;
+        if (!concurrentMode && newCount > 1)
+            capacity = 1 << (32 - __builtin_clz(newCount - 1));
+        array = (ChildArray *)malloc(sizeof(ChildArray) + capacity * sizeof(TrieNode *));
+        if (!array)
+            return false;
+        COUNT_ALLOCATION();
+        if (old)
+        {
+            // Children before pos stay in place; the ones after it shift by one slot
+            memcpy(array->mask, old->mask, sizeof(array->mask));
+            memcpy(array->children, old->children, pos * sizeof(TrieNode *));
+            if (present)
+                memcpy(&array->children[pos], &old->children[pos + 1], (count - pos - 1) * sizeof(TrieNode *));
+            else
+                memcpy(&array->children[pos + 1], &old->children[pos], (count - pos) * sizeof(TrieNode *));
+        }
+        else
+            memset(array->mask, 0, sizeof(array->mask));
+        if (!present)
+            array->children[pos] = child;
+        array->mask[byte >> 6] ^= bit;
+        array->count = newCount;
+        array->capacity = capacity;
+        updateChildRanks(array);
+    }
+    STORE_RELEASE(node->children, array);
+    if (old)
+    {
+        if (concurrentMode)
+            retireObject(old, false); // Readers may still be searching the old array
+        else
+            free(old);
+    }
+    return true;
+}
+
+/**
+ * @brief Steps through the children of a node in byte order, visiting only the set mask bits.
+ * Start with *byte = -1; each call returns the next child and stores its edge byte in *byte.
+ * @param node The parent node.
+ * @param byte In: the byte of the previous child (-1 to start). Out: the byte of the returned child.
+ * @return The next child, or NULL when there are no more.
+ */
+static TrieNode *nextChild(TrieNode *node, int *byte)
+{
+    ChildArray *array = LOAD_ACQUIRE(node->children);
+    int from = *byte + 1;
+    if (isSoleChild(array))
+    {
+        if (node->soleByte < from)
+            return NULL; // Already visited
+        *byte = node->soleByte;
+        return soleChild(array);
+    }
+    if (!array || from >= BYTE_VALUES)
+        return NULL;
+    // Mask off the bytes already visited, then take the lowest remaining bit
+    int i = from >> 6;
+    uint64_t bits = array->mask[i] & (~0ULL << (from & 63));
+    while (!bits && ++i < CHILD_MASK_WORDS)
+        bits = array->mask[i];
+    if (!bits)
+        return NULL;
+    *byte = i * 64 + __builtin_ctzll(bits);
+    return LOAD_ACQUIRE(array->children[childSlot(array, *byte)]);
+}
+
+// --- RANKED COMPLETION FUNCTIONS ---
+
+/**
+ * @brief Looks up how often a word/prefix has been searched.
+ * @param word The word to look up.
+ * @return The recorded search count (the decayed estimate in STATS_SKETCH mode), or 0 if it was never searched.
+ */
+static int getSearchCount(const char *word)
+{
+    if (statsMode == STATS_SKETCH)
+        return sketchSearchCount(word);
+    if (searchStats.count == 0)
+        return 0;
+    WordFrequency *slot = findStatsSlot(word, hashWord(word));
+    return slot->word ? slot->frequency : 0;
+}
+
+/**
+ * @brief Returns the key a word is ranked by.
+ * Sketched counts are decayed to the time of each word's last search, so comparing them would favour
+ * words searched heavily long ago. Their scaled weights are all relative to the sketch landmark instead,
+ * so they compare correctly without being aged (rescaleSketch() keeps them on that landmark).
+ * @param word The word.
+ * @param frequency The word's search count, as returned by getSearchCount() or updateFrequency().
+ * @return The count itself, or the word's scaled weight in STATS_SKETCH mode.
+ */
+static double getSearchWeight(const char *word, int frequency)
+{
+    if (statsMode != STATS_SKETCH)
+        return frequency;
+    return searchSketch.landmark ? sketchEstimate(hashWord(word)) : 0;
+}
+
+/**
+ * @brief Decays the search count of a word that is handed out to the current time.
+ * Only needed in STATS_SKETCH mode; exact counts are always current.
+ * @param info The word record.
+ * @param weight sketchWeight() of the current time.
+ */
+static void decayFrequency(WordInfo *info, double weight)
+{
+    info->frequency = (int)(info->weight / weight + 0.5);
+}
+
+/**
+ * @brief Decides whether one word ranks above another: higher weight (more searches) first, then alphabetical.
+ * @param a The first word record.
+ * @param b The second word record.
+ * @return true if a should be listed before b.
+ */
+static bool ranksHigher(const WordInfo *a, const WordInfo *b)
+{
+    if (a->weight != b->weight)
+        return a->weight > b->weight;
+    return strcmp(a->word, b->word) < 0;
+}
+
+/**
+ * @brief Offers a word to a node's cached top-K list, keeping the list sorted best first.
+ * If the word is already listed it is re-positioned, which handles frequency increases.
+ * @param node The node whose cache is updated.
+ * @param info The word record to offer.
+ */
+static void offerTopWord(TrieNode *node, WordInfo *info)
+{
+    int count = node->topCount;
+    // Take the word out first if it is already cached
+    for (int i = 0; i < count; i++)
+    {
+        if (node->topWords[i] == info)
+        {
+            memmove(&node->topWords[i], &node->topWords[i + 1], (count - i - 1) * sizeof(WordInfo *));
+            count--;
+            break;
+        }
+    }
+    // Find the word's position; if the list is full and it ranks below everything, drop it
+    int pos = count;
+    while (pos > 0 && ranksHigher(info, node->topWords[pos - 1]))
+        pos--;
+    if (pos == TOP_K)
+    {
+        node->topCount = count;
+        return;
+    }
+    if (count == TOP_K)
+        count--; // The last entry falls off the end
+    memmove(&node->topWords[pos + 1], &node->topWords[pos], (count - pos) * sizeof(WordInfo *));
+    node->topWords[pos] = info;
+    node->topCount = count + 1;
+}
+
+/**
+ * @brief Rebuilds a node's top-K cache from its own word and its children's caches.
+ * Used after a cached word is deleted, when the list may need refilling from below.
+ * @param node The node whose cache is rebuilt.
+ */
+static void recomputeTopWords(TrieNode *node)
+{
+    node->topCount = 0;
+    if (node->isEndOfWord)
+        offerTopWord(node, node->info);
+    // Every word below a child that could make our list is already in that child's list
+    TrieNode *child;
+    for (int byte = -1; (child = nextChild(node, &byte));)
+        for (int j = 0; j < child->topCount; j++)
+            offerTopWord(node, child->topWords[j]);
+}
+
+// --- TRIE FUNCTIONS ---
+
+/**
+ * @brief Creates and initializes a new TrieNode.
+ * @return A pointer to the newly allocated TrieNode, or NULL if allocation fails.
+ */
+TrieNode *createNode()
+{
+    // Take a node from the slab allocator instead of calling malloc for every node
+    TrieNode *newNode = poolAlloc(activePool);
+    if (newNode)
+    {
+        // Mark that this node is not the end of a word by default
+        newNode->isEndOfWord = false;
+        newNode->info = NULL;
+        newNode->topCount = 0; // No words below this node yet
+        newNode->wordCount = 0;
+        newNode->children = NULL; // No children yet
+    }
+    return newNode;
+}
+
+/**
+ * @brief Frees the whole Trie (every node ever created) in a single call.
+ * All nodes live in the global node pool, so this releases the slabs rather than walking the Trie.
+ * The root must be recreated with createNode() before the Trie is used again.
+ */
+void destroyTrie()
+{
+    // Free nodes keep their free-list link where the children pointer is, so clear it first
+    for (TrieNode *node = nodePool.freeList, *next; node; node = next)
+    {
+        next = node->nextFree;
+        node->children = NULL;
+    }
+    // Word records and child arrays are separate allocations, so free them before dropping the slabs
+    for (NodeSlab *slab = nodePool.slabs; slab; slab = slab->next)
+    {
+        for (int i = 0; i < slab->used; i++)
+        {
+            free(slab->nodes[i].info);
+            if (!isSoleChild(slab->nodes[i].children))
+                free(slab->nodes[i].children);
+        }
+    }
+    poolRelease(&nodePool);
+    memset(&wordLengths, 0, sizeof(wordLengths)); // Every word is gone
+}
+
+/**
+ * @brief Returns the length of the UTF-8 sequence that starts with a given byte.
+ * @param byte The first byte of the sequence.
+ * @return 1 to 4; stray continuation bytes and invalid lead bytes count as 1.
+ */
+static int utf8SequenceLength(unsigned char byte)
+{
+    if (byte >= 0xF0 && byte <= 0xF4)
+        return 4;
+    if (byte >= 0xE0)
+        return byte <= 0xEF ? 3 : 1;
+    if (byte >= 0xC2)
+        return 2;
+    return 1;
+}
+
+/**
+ * @brief Decodes one UTF-8 character.
+ * Malformed input is decoded one byte at a time, so every byte string can be processed. Overlong
+ * forms, UTF-16 surrogates and values above U+10FFFF count as malformed, so a decoded code point
+ * is always a Unicode scalar value.
+ * @param str The bytes to decode (null-terminated).
+ * @param codePoint Receives the decoded code point.
+ * @return The number of bytes consumed (at least 1).
+ */
+static int decodeUtf8(const unsigned char *str, uint32_t *codePoint)
+{
+    int len = utf8SequenceLength(str[0]);
+    if (len == 1)
+    {
+        *codePoint = str[0];
+        return 1;
+    }
+    // Some lead bytes allow only part of the continuation range in the second byte (RFC 3629)
+    unsigned char low = str[0] == 0xE0 ? 0xA0 : str[0] == 0xF0 ? 0x90 : 0x80;
+    unsigned char high = str[0] == 0xED ? 0x9F : str[0] == 0xF4 ? 0x8F : 0xBF;
+    if (str[1] < low || str[1] > high)
+    {
+        *codePoint = str[0]; // Overlong, surrogate or out of range: take the lead byte on its own
+        return 1;
+    }
+    uint32_t value = str[0] & (0x7F >> len); // Payload bits of the lead byte
+    for (int i = 1; i < len; i++)
+    {
+        if ((str[i] & 0xC0) != 0x80)
+        {
+            *codePoint = str[0]; // Truncated sequence: take the lead byte on its own
+            return 1;
+        }
+        value = value << 6 | (str[i] & 0x3F);
+    }
+    *codePoint = value;
+    return len;
+}
+
+/**
+ * @brief Encodes a code point as UTF-8.
+ * @param codePoint The code point (below 0x110000).
+ * @param out Buffer with room for 4 bytes.
+ * @return The number of bytes written.
+ */
+static int encodeUtf8(uint32_t codePoint, unsigned char *out)
+{
+    if (codePoint < 0x80)
+    {
+        out[0] = codePoint;
+        return 1;
+    }
+    if (codePoint < 0x800)
+    {
+        out[0] = 0xC0 | codePoint >> 6;
+        out[1] = 0x80 | (codePoint & 0x3F);
+        return 2;
+    }
+    if (codePoint < 0x10000)
+    {
+        out[0] = 0xE0 | codePoint >> 12;
+        out[1] = 0x80 | (codePoint >> 6 & 0x3F);
+        out[2] = 0x80 | (codePoint & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | codePoint >> 18;
+    out[1] = 0x80 | (codePoint >> 12 & 0x3F);
+    out[2] = 0x80 | (codePoint >> 6 & 0x3F);
+    out[3] = 0x80 | (codePoint & 0x3F);
+    return 4;
+}
+
+/**
+ * @brief Maps a code point to its case-folded (lowercase) form.
+ * Follows the simple (one-to-one) mappings of CaseFolding.txt for the scripts with case pairs:
+ * Latin (including Latin-1 and Extended-A), Greek, Cyrillic, Armenian and the full-width Latin letters.
+ * @param c The code point.
+ * @return The folded code point (c itself if it has no lowercase form).
+ */
+static uint32_t foldCodePoint(uint32_t c)
+{
+    if (c < 0x80)
+        return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    if ((c >= 0xC0 && c <= 0xDE && c != 0xD7) || // Latin-1 letters (not the multiplication sign)
+        (c >= 0x391 && c <= 0x3AB && c != 0x3A2) || // Greek capitals
+        (c >= 0x410 && c <= 0x42F) ||               // Basic Cyrillic capitals
+        (c >= 0xFF21 && c <= 0xFF3A))               // Full-width Latin capitals
+        return c + 0x20;
+    if (c == 0xB5)
+        return 0x3BC; // Micro sign folds to Greek mu
+    if (c == 0x130)
+        return c; // Capital I with dot above has only a full folding ("i" + U+0307) and a Turkic one ("i")
+    if (c == 0x178)
+        return 0xFF; // Y with diaeresis
+    if (c == 0x4C0)
+        return 0x4CF; // Cyrillic palochka
+    if (c == 0x17F)
+        return 's'; // Long s
+    if (c == 0x3C2)
+        return 0x3C3; // Final sigma folds to sigma
+    if (c >= 0x388 && c <= 0x38A)
+        return c + 0x25; // Greek capitals with tonos
+    if (c == 0x386)
+        return 0x3AC;
+    if (c == 0x38C)
+        return 0x3CC;
+    if (c == 0x38E || c == 0x38F)
+        return c + 0x3F;
+    if (c >= 0x400 && c <= 0x40F)
+        return c + 0x50; // Cyrillic capitals with diacritics (Ѐ..Џ)
+    if (c >= 0x531 && c <= 0x556)
+        return c + 0x30; // Armenian capitals
+    if (c == 0x212A)
+        return 'k'; // Kelvin sign
+    if (c == 0x212B)
+        return 0xE5; // Angstrom sign
+    // Latin Extended-A and the Cyrillic extensions alternate capital/small in pairs
+    if ((c >= 0x100 && c <= 0x137) || (c >= 0x14A && c <= 0x177) ||
+        (c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || (c >= 0x4D0 && c <= 0x52F))
+        return c | 1;
+    if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E) || (c >= 0x4C1 && c <= 0x4CE))
+        return (c & 1) ? c + 1 : c;
+    return c;
+}
+
+/**
+ * @brief Case-folds a UTF-8 string in place, so words can be matched regardless of case.
+ * Folding never makes a character longer, so the result always fits in the original buffer.
+ * Invalid UTF-8 bytes are kept unchanged.
+ * @param str The string to be converted.
+ */
+void foldCase(char *str)
+{
+    unsigned char *in = (unsigned char *)str, *out = (unsigned char *)str;
+    while (*in)
+    {
+        // Plain ASCII is by far the most common case, so handle it without decoding
+        if (*in < 0x80)
+        {
+            *out++ = *in >= 'A' && *in <= 'Z' ? *in + ('a' - 'A') : *in;
+            in++;
+            continue;
+        }
+        uint32_t codePoint;
+        int len = decodeUtf8(in, &codePoint);
+        uint32_t folded = foldCodePoint(codePoint);
+        if (len == 1 || folded == codePoint)
+        {
+            memmove(out, in, len); // Unchanged (or not valid UTF-8): copy the bytes as they are
+            out += len;
+        }
+        else
+            out += encodeUtf8(folded, out);
+        in += len;
+    }
+    *out = '\0';
+}
+
+/**
+ * @brief Counts the characters (code points) of a UTF-8 string.
+ * @param str The string.
+ * @return The number of characters; invalid bytes count as one character each.
+ */
+static int utf8Length(const char *str)
+{
+    int count = 0;
+    uint32_t codePoint;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p += decodeUtf8(p, &codePoint))
+        count++;
+    return count;
+}
+
+/**
+ * @brief Adds a word to, or removes it from, the length index of the calling thread.
+ * @param word The word that was inserted or deleted.
+ * @param delta 1 for an insertion, -1 for a deletion.
+ */
+static void trackWordLength(const char *word, int delta)
+{
+    int len = utf8Length(word); // Length in characters, not bytes
+    if (len < MAX_WORD_LEN)
+        activeLengths->counts[len] += delta;
+}
+
+/**
+ * @brief Inserts a word below a given node of the Trie.
+ * @param from The node that stands for the first skip letters of the word.
+ * @param word The whole word to insert.
+ * @param skip Number of leading letters already matched by from.
+ */
+static void insertAt(TrieNode *from, const char *word, int skip)
+{
+    const char *start = word; // Remember the whole word for its ranking record
+    TrieNode *node = from;
+    word += skip;
+    // Iterate through each character of the word
+    while (*word)
+    {
+        // Any byte can label an edge, so multi-byte UTF-8 characters take one level per byte
+        unsigned char byte = *word;
+        TrieNode *child = getChild(node, byte);
+        // If the child node for this byte doesn't exist, create it
+        if (!child)
+        {
+            child = createNode();
+            if (!child || !setChild(node, byte, child))
+                return; // Out of memory (an unlinked node just stays unused in the pool)
+        }
+        // Move to the child node
+        node = child;
+        // Move to the next byte of the word
+        word++;
+    }
+    if (node->isEndOfWord)
+        return; // Already present, so the rankings do not change
+
+    // After inserting all characters, mark the final node as the end of a word
+    WordInfo *info = (WordInfo *)malloc(sizeof(WordInfo) + strlen(start) + 1);
+    if (!info)
+        return;
+    COUNT_ALLOCATION();
+    strcpy(info->word, start);
+    info->frequency = getSearchCount(start);
+    info->weight = getSearchWeight(start, info->frequency);
+    node->info = info;
+    STORE_RELEASE(node->isEndOfWord, true);
+    trackWordLength(start, 1);
+
+    // A new word can only enter caches, so offer it to every node on its path and count it there
+    node = from;
+    offerTopWord(node, info);
+    node->wordCount++;
+    for (const char *c = start + skip; *c; c++)
+    {
+        node = getChild(node, *c);
+        offerTopWord(node, info);
+        node->wordCount++;
+    }
+}
+
+/**
+ * @brief Inserts a word into the Trie.
+ * @param root The root node of the Trie.
+ * @param word The word to insert.
+ */
+void insert(TrieNode *root, const char *word)
+{
+    insertAt(root, word, 0);
+}
+
+/**
+ * @brief Searches for a prefix in the Trie and returns the node where the prefix ends.
+ * @param root The root node of the Trie.
+ * @param prefix The prefix to search for.
+ * @return The TrieNode at the end of the prefix, or NULL if the prefix is not found.
+ */
+TrieNode *searchPrefix(TrieNode *root, const char *prefix)
+{
+    METRIC_START(start);
+    TrieNode *node = root;
+    // Iterate through each character of the prefix
+    while (*prefix && node)
+    {
+        METRIC_COUNT(queryNodes);
+        // Load the child once; a writer may be changing it concurrently
+        // (NULL if there's no path for this character, so the prefix doesn't exist)
+        node = getChild(node, *prefix);
+        prefix++;
+    }
+    METRIC_STOP(METRIC_SEARCH_PREFIX, start);
+    // Return the node where the prefix ends
+    return node;
+}
+
+/**
+ * @brief Recursively collects all words starting from a given Trie node and passes them to a sink.
+ * This function performs a Depth-First Search (DFS).
+ * @param node The starting node for collection.
+ * @param buffer A character buffer to build the current word.
+ * @param depth The current depth in the Trie (length of the word in the buffer).
+ * @param sink Called with every word, in alphabetical order.
+ * @param context Passed to the sink unchanged.
+ */
+void collectWords(TrieNode *node, char *buffer, int depth, WordSink sink, void *context)
+{
+    METRIC_COUNT(queryNodes);
+    // If the current node marks the end of a word, hand the word to the sink
+    if (LOAD_ACQUIRE(node->isEndOfWord))
+    {
+        buffer[depth] = '\0'; // Null-terminate the string
+        METRIC_COUNT(queryWords);
+        sink(buffer, context);
+    }
+    // Recur for all children of the current node, in byte order: walk the set bits of the
+    // presence mask, whose children sit in consecutive slots of the packed array
+    ChildArray *array = LOAD_ACQUIRE(node->children);
+    if (isSoleChild(array))
+    {
+        buffer[depth] = node->soleByte;
+        collectWords(soleChild(array), buffer, depth + 1, sink, context);
+        return;
+    }
+    if (!array)
+        return;
+    int slot = 0;
+    for (int i = 0; i < CHILD_MASK_WORDS; i++)
+    {
+        for (uint64_t bits = array->mask[i]; bits; bits &= bits - 1)
+        {
+            // Add the byte to the buffer
+            buffer[depth] = i * 64 + __builtin_ctzll(bits);
+            // Recursively call for the child node, increasing the depth
+            collectWords(LOAD_ACQUIRE(array->children[slot++]), buffer, depth + 1, sink, context);
+        }
+    }
+}
+
+/**
+ * @brief Checks if a TrieNode has any children.
+ * @param node The node to check.
+ * @return true if the node has no children, false otherwise.
+ */
+bool isEmpty(TrieNode *node)
+{
+    return !node->children; // The child array (or only child) is dropped when its last child goes
+}
+
+/**
+ * @brief A recursive helper function to delete a word from the Trie.
+ * @param node The current node in the traversal.
+ * @param word The remaining part of the word to delete.
+ * @return true if the parent node should delete the reference to this node.
+ */
+static bool deleteWordHelper(TrieNode *node, const char *word)
+{
+    // If we haven't reached the end of the word
+    if (*word)
+    {
+        TrieNode *child = getChild(node, *word);
+        // If the path doesn't exist, the word isn't in the trie
+        if (!child)
+            return false;
+
+        // Recur for the next byte
+        uint32_t childWords = child->wordCount;
+        bool shouldDeleteChild = deleteWordHelper(child, word + 1);
+        if (child->wordCount < childWords)
+            node->wordCount--; // The word was found below, so this subtree lost it too
+
+        // If the recursive call indicates the child node should be deleted
+        if (shouldDeleteChild && setChild(node, *word, NULL)) // Unlink first, so readers can no longer reach it
+        {
+            releaseNode(child); // Then give the child node back to the pool
+            // Return true if this node is not an end of another word and has no other children
+            return !node->isEndOfWord && isEmpty(node);
+        }
+    }
+    // If we have reached the end of the word
+    else if (node->isEndOfWord)
+    {
+        STORE_RELEASE(node->isEndOfWord, false); // Unmark it as the end of a word
+        trackWordLength(node->info->word, -1);
+        node->wordCount--;
+        node->info = NULL;         // The caller owns (and frees) the word record now
+        // If this node has no children, it's safe to delete
+        return isEmpty(node);
+    }
+    return false; // Default case
+}
+
+/**
+ * @brief Purges a deleted word from the top-K caches along its path, refilling them from below.
+ * @param node The current node in the traversal (the root on the first call).
+ * @param word The remaining part of the deleted word.
+ * @param info The record of the deleted word.
+ */
+static void dropTopWord(TrieNode *node, const char *word, const WordInfo *info)
+{
+    // Fix the deeper caches first, since a rebuilt list is merged from its children's lists
+    TrieNode *child = *word ? getChild(node, *word) : NULL;
+    if (child)
+        dropTopWord(child, word + 1, info);
+    for (int i = 0; i < node->topCount; i++)
+    {
+        if (node->topWords[i] == info)
+        {
+            recomputeTopWords(node);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Deletes a word from the Trie and keeps the cached rankings up to date.
+ * @param root The root of the Trie.
+ * @param word The word to delete.
+ */
+static void removeFromTrie(TrieNode *root, const char *word)
+{
+    TrieNode *end = searchPrefix(root, word);
+    if (!end || !end->isEndOfWord)
+        return;
+    WordInfo *info = end->info;
+    deleteWordHelper(root, word);
+    dropTopWord(root, word, info);
+    releaseWordInfo(info); // No cache refers to the record any more
+}
+
+/**
+ * @brief Searches for a complete word in the Trie.
+ * @param root The root of the Trie.
+ * @param word The word to search for.
+ * @return true if the word exists, false otherwise.
+ */
+bool searchWord(TrieNode *root, const char *word)
+{
+    TrieNode *node = root;
+    while (*word)
+    {
+        node = getChild(node, *word);
+        if (!node)
+            return false; // Path does not exist
+        word++;
+    }
+    // The word exists only if the final node is not null AND it's marked as the end of a word
+    return LOAD_ACQUIRE(node->isEndOfWord);
+}
+
+// --- COMPLETION CURSOR ---
+
+/**
+ * @brief Positions a cursor on the completions of a prefix, optionally resuming after a token.
+ * The token is simply the last word of the previous page, so it stays valid across separate runs
+ * and even after words were added or deleted in between: the cursor resumes at the first
+ * completion that sorts after it.
+ * @param cursor The cursor to initialize.
+ * @param root The root node of the Trie.
+ * @param prefix The prefix to complete ("" for every word).
+ * @param after Continuation token (the last word already returned), or NULL/"" to start at the beginning.
+ * @return false if the prefix is not found or the token does not start with the prefix.
+ */
+bool cursorOpen(CompletionCursor *cursor, TrieNode *root, const char *prefix, const char *after)
+{
+    cursor->depth = 0;
+    cursor->prefixLen = strlen(prefix);
+    TrieNode *node = searchPrefix(root, prefix);
+    if (!node || cursor->prefixLen >= MAX_WORD_LEN)
+        return false;
+    if (!after)
+        after = "";
+    int afterLen = strlen(after);
+    if (*after && (afterLen >= MAX_WORD_LEN || strncmp(after, prefix, cursor->prefixLen) != 0))
+        return false;
+
+    strcpy(cursor->word, prefix);
+    cursor->nodes[0] = node;
+    cursor->bytes[0] = -1;
+    cursor->depth = 1;
+    cursor->emitPending = !*after;
+
+    // Rebuild the path of the token: everything up to and including it was already returned
+    for (int len = cursor->prefixLen; len < afterLen; len++)
+    {
+        int level = cursor->depth - 1;
+        unsigned char byte = after[len];
+        cursor->bytes[level] = byte; // Continue after this child, whether or not it still exists
+        cursor->word[len] = byte;
+        TrieNode *child = getChild(cursor->nodes[level], byte);
+        if (!child)
+            break; // The token's word is gone; its would-be subtree is empty anyway
+        cursor->nodes[level + 1] = child;
+        cursor->bytes[level + 1] = -1;
+        cursor->depth++;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the next completion in alphabetical order, visiting only the nodes needed for it.
+ * @param cursor A cursor set up by cursorOpen().
+ * @return The word, valid until the next call (it is also the continuation token), or NULL when done.
+ */
+const char *cursorNext(CompletionCursor *cursor)
+{
+    while (cursor->depth > 0)
+    {
+        int level = cursor->depth - 1;
+        int len = cursor->prefixLen + level; // Length of the word ending at the deepest node
+        TrieNode *node = cursor->nodes[level];
+        if (cursor->emitPending)
+        {
+            cursor->emitPending = false;
+            if (LOAD_ACQUIRE(node->isEndOfWord))
+            {
+                cursor->word[len] = '\0';
+                return cursor->word;
+            }
+        }
+
+        // Descend into the next child, or climb back up once the node is exhausted
+        // (the length check keeps the word and the path inside their buffers)
+        TrieNode *child = len < MAX_WORD_LEN - 1 ? nextChild(node, &cursor->bytes[level]) : NULL;
+        if (!child)
+        {
+            cursor->depth--;
+            continue;
+        }
+        METRIC_COUNT(queryNodes);
+        cursor->word[len] = cursor->bytes[level];
+        cursor->nodes[level + 1] = child;
+        cursor->bytes[level + 1] = -1;
+        cursor->depth++;
+        cursor->emitPending = true;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Copies up to n further completions out of a cursor.
+ * @param cursor A cursor set up by cursorOpen().
+ * @param words Array that receives the words.
+ * @param n The most words wanted.
+ * @return The number of words written; fewer than n means every completion was returned.
+ */
+int cursorNextBatch(CompletionCursor *cursor, char (*words)[MAX_WORD_LEN], int n)
+{
+    int count = 0;
+    const char *word;
+    while (count < n && (word = cursorNext(cursor)))
+        strcpy(words[count++], word);
+    return count;
+}
+
+// --- COUNTING, RANK AND SELECT ---
+
+/**
+ * @brief Counts the words that start with a prefix, using the word counts kept in every node.
+ * @param root The root node of the Trie.
+ * @param prefix The prefix ("" counts every word).
+ * @return The number of words with that prefix.
+ */
+long countPrefix(TrieNode *root, const char *prefix)
+{
+    TrieNode *node = searchPrefix(root, prefix);
+    return node ? (long)node->wordCount : 0;
+}
+
+/**
+ * @brief Returns the position a word has, or would have, in the alphabetical list of all words.
+ * @param root The root node of the Trie.
+ * @param word The word; it does not have to be in the Trie.
+ * @return The number of words that sort before it.
+ */
+long rankWord(TrieNode *root, const char *word)
+{
+    long rank = 0;
+    TrieNode *node = root;
+    for (const unsigned char *p = (const unsigned char *)word; *p; p++)
+    {
+        // A word ending here is a prefix of the given word, so it sorts first, as do the smaller siblings
+        rank += node->isEndOfWord;
+        TrieNode *child;
+        for (int byte = -1; (child = nextChild(node, &byte)) && byte < *p;)
+            rank += child->wordCount;
+        node = getChild(node, *p);
+        if (!node)
+            break; // No further word shares the path, so every smaller one has been counted
+    }
+    return rank;
+}
+
+/**
+ * @brief Finds the word at a given position among the completions of a prefix, in alphabetical order.
+ * @param root The root node of the Trie.
+ * @param prefix The prefix ("" selects among all words).
+ * @param k The zero-based position.
+ * @param word Receives the word (MAX_WORD_LEN bytes).
+ * @return true if there is such a word, false if k is not below countPrefix(root, prefix).
+ */
+bool selectWord(TrieNode *root, const char *prefix, long k, char *word)
+{
+    TrieNode *node = searchPrefix(root, prefix);
+    if (!node || k < 0 || k >= (long)node->wordCount)
+        return false;
+    int depth = strlen(prefix);
+    strcpy(word, prefix);
+    for (;;)
+    {
+        if (node->isEndOfWord && k-- == 0)
+            break;
+        // Skip whole subtrees until the one holding the k-th word
+        TrieNode *child;
+        int byte = -1;
+        while ((child = nextChild(node, &byte)) && k >= (long)child->wordCount)
+            k -= child->wordCount;
+        if (!child)
+            return false; // Counts out of step with the nodes; only possible while a writer is running
+        word[depth++] = byte;
+        node = child;
+    }
+    word[depth] = '\0';
+    return true;
+}
+
+// --- CONCURRENT ACCESS FUNCTIONS ---
+
+/**
+ * @brief Enters concurrency mode: from now on nodes and word records unlinked by the writer are
+ * retired instead of freed, so reader threads can walk the Trie between readerEnter() and readerExit().
+ * Call it before starting the readers.
+ */
+void beginConcurrentMode()
+{
+    concurrentMode = true;
+}
+
+/**
+ * @brief Leaves concurrency mode once every reader thread has stopped.
+ * Frees everything still retired and releases all reader slots.
+ */
+void endConcurrentMode()
+{
+    readerCount = 0;
+    reclaimRetired(); // No readers are left, so everything still retired can be freed
+    concurrentMode = false;
+    free(retireList.items);
+    retireList = (RetireList){NULL, 0, 0};
+}
+
+/**
+ * @brief Inserts a word while lock-free readers may be running.
+ * Writers are serialized by a mutex; readers are never blocked.
+ * @param root The root node of the Trie.
+ * @param word The word to insert.
+ */
+void concurrentInsert(TrieNode *root, const char *word)
+{
+    pthread_mutex_lock(&writerLock);
+    insert(root, word);
+    pthread_mutex_unlock(&writerLock);
+}
+
+/**
+ * @brief Deletes a word while lock-free readers may be running.
+ * Removed nodes are retired and only reused once every reader has moved past them.
+ * @param root The root node of the Trie.
+ * @param word The word to delete.
+ */
+void concurrentDelete(TrieNode *root, const char *word)
+{
+    pthread_mutex_lock(&writerLock);
+    removeFromTrie(root, word);
+    reclaimRetired();
+    pthread_mutex_unlock(&writerLock);
+}
+
+/**
+ * @brief Word sink that only counts the words it receives.
+ * @param word The word (ignored).
+ * @param context Pointer to the long long counter.
+ */
+void countWord(const char *word, void *context)
+{
+    (void)word;
+    (*(long long *)context)++;
+}
+
+/**
+ * @brief Body of a reader thread for the concurrency stress run.
+ * Repeatedly looks up every dictionary word and completes its first two letters without taking any lock.
+ * @param arg The thread's ReaderTask.
+ * @return NULL.
+ */
+static void *readerThread(void *arg)
+{
+    ReaderTask *task = (ReaderTask *)arg;
+    int slot = registerReader();
+    if (slot < 0)
+        return NULL;
+
+    char buffer[MAX_WORD_LEN];
+    long long operations = 0, errors = 0; // Kept local so threads do not share cache lines
+    long long completions = 0;            // Words handed to the sink, so the walks are not skipped
+    while (!__atomic_load_n(task->stop, __ATOMIC_RELAXED))
+    {
+        for (int i = 0; i < task->wordCount; i++)
+        {
+            const char *word = task->words[i];
+            readerEnter(slot);
+            // Dictionary words are never deleted by the writer, so they must always be found
+            if (!searchWord(task->root, word))
+                errors++;
+            char prefix[3] = {word[0], word[1], '\0'};
+            TrieNode *node = searchPrefix(task->root, prefix);
+            if (node)
+            {
+                strcpy(buffer, prefix);
+                collectWords(node, buffer, strlen(prefix), countWord, &completions);
+            }
+            readerExit(slot);
+            operations += 2;
+        }
+    }
+    task->operations = operations;
+    task->errors = errors;
+    task->completions = completions;
+    return NULL;
+}
+
+/**
+ * @brief Collects every word of the Trie into an array (used to drive the stress run).
+ * @param node The current node.
+ * @param buffer Buffer holding the current word.
+ * @param depth Current depth in the Trie.
+ * @param words Array receiving heap copies of the words.
+ * @param count Pointer to the number of words stored so far.
+ * @param capacity Size of the words array.
+ */
+static void gatherWords(TrieNode *node, char *buffer, int depth, char **words, int *count, int capacity)
+{
+    if (node->isEndOfWord && *count < capacity)
+    {
+        buffer[depth] = '\0';
+        words[*count] = (char *)malloc(depth + 1);
+        if (words[*count])
+            strcpy(words[(*count)++], buffer);
+    }
+    TrieNode *child;
+    for (int byte = -1; (child = nextChild(node, &byte));)
+    {
+        buffer[depth] = byte;
+        gatherWords(child, buffer, depth + 1, words, count, capacity);
+    }
+}
+
+/**
+ * @brief Runs lock-free reader threads against a writer that keeps inserting and deleting words.
+ * Measures reader throughput and counts any lookup that missed a word that was never deleted.
+ * @param root The root node of the loaded (non-empty) Trie.
+ * @param readers The number of reader threads to start (1 to MAX_READERS).
+ * @param seconds How long the writer keeps updating the Trie.
+ * @param report Receives the results of the run.
+ * @return false if the run could not be started or a reader thread failed to start, true otherwise.
+ */
+bool runConcurrencyStress(TrieNode *root, int readers, double seconds, StressReport *report)
+{
+    if (readers < 1 || readers > MAX_READERS || seconds <= 0)
+        return false;
+
+    // Take a fixed copy of the dictionary words for the readers to look up
+    int capacity = 100000, wordCount = 0;
+    char **words = (char **)malloc(capacity * sizeof(char *));
+    char buffer[MAX_WORD_LEN];
+    if (!words)
+        return false;
+    gatherWords(root, buffer, 0, words, &wordCount, capacity);
+    if (wordCount == 0)
+    {
+        free(words);
+        return false;
+    }
+
+    int stop = 0;
+    pthread_t *threads = (pthread_t *)malloc(readers * sizeof(pthread_t));
+    ReaderTask *tasks = (ReaderTask *)calloc(readers, sizeof(ReaderTask));
+    if (!threads || !tasks)
+    {
+        for (int i = 0; i < wordCount; i++)
+            free(words[i]);
+        free(words);
+        free(threads);
+        free(tasks);
+        return false;
+    }
+
+    beginConcurrentMode();
+    int started = 0;
+    for (; started < readers; started++)
+    {
+        tasks[started] = (ReaderTask){root, (const char **)words, wordCount, &stop, 0, 0, 0};
+        if (pthread_create(&threads[started], NULL, readerThread, &tasks[started]) != 0)
+            break; // The threads already running are stopped below without any writes
+    }
+
+    // The main thread is the writer: add and remove words that share prefixes with real ones
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    now = start;
+    long writes = 0;
+    while (started == readers && (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 < seconds)
+    {
+        char word[MAX_WORD_LEN];
+        snprintf(word, sizeof(word), "%.2sqx%c%c", words[writes % wordCount],
+                 'a' + (int)(writes % 26), 'a' + (int)(writes / 26 % 26));
+        concurrentInsert(root, word);
+        concurrentDelete(root, word);
+        writes += 2;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    *report = (StressReport){started, 0, 0, writes, 0};
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+        report->reads += tasks[i].operations;
+        report->errors += tasks[i].errors;
+    }
+    report->seconds = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+    endConcurrentMode();
+
+    for (int i = 0; i < wordCount; i++)
+        free(words[i]);
+    free(words);
+    free(threads);
+    free(tasks);
+    return started == readers;
+}
+
+// --- RADIX TREE (PATRICIA) FUNCTIONS ---
+
+/**
+ * @brief Creates a radix tree node whose incoming edge is labelled with the given bytes.
+ * @param label The edge label (does not need to be null-terminated), or NULL to leave it unset.
+ * @param labelLen The number of bytes in the label.
+ * @return A pointer to the newly allocated RadixNode, or NULL if allocation fails.
+ */
+static RadixNode *createRadixNode(const char *label, int labelLen)
+{
+    // The label is stored inline right after the node, so one malloc covers both
+    RadixNode *newNode = (RadixNode *)malloc(sizeof(RadixNode) + labelLen);
+    if (newNode)
+    {
+        COUNT_ALLOCATION();
+        newNode->children = NULL;
+        newNode->childCount = 0;
+        newNode->childCapacity = 0;
+        newNode->labelLen = labelLen;
+        newNode->isEndOfWord = false;
+        if (label)
+            memcpy(newNode->label, label, labelLen);
+    }
+    return newNode;
+}
+
+/**
+ * @brief Recursively frees a radix tree node and all of its descendants.
+ * @param node The node to free.
+ */
+static void destroyRadixTree(RadixNode *node)
+{
+    if (!node)
+        return;
+    for (int i = 0; i < node->childCount; i++)
+        destroyRadixTree(node->children[i]);
+    free(node->children);
+    free(node);
+}
+
+/**
+ * @brief Frees the radix tree of the radix engine, if setEngine() created one.
+ */
+void closeRadixTree()
+{
+    destroyRadixTree(radixRoot);
+    radixRoot = NULL;
+}
+
+/**
+ * @brief Finds the child whose edge label starts with a given byte.
+ * @param node The parent node.
+ * @param c The first byte of the wanted edge.
+ * @param pos Receives the index of the child, or the index where it would be inserted.
+ * @return The matching child, or NULL if there is none.
+ */
+static RadixNode *findRadixChild(RadixNode *node, char c, int *pos)
+{
+    int i = 0;
+    // Children are kept sorted by their first byte, so stop as soon as we pass c
+    while (i < node->childCount && (unsigned char)node->children[i]->label[0] < (unsigned char)c)
+        i++;
+    *pos = i;
+    if (i < node->childCount && node->children[i]->label[0] == c)
+        return node->children[i];
+    return NULL;
+}
+
+/**
+ * @brief Inserts a child pointer into a node's sorted children array.
+ * @param node The parent node.
+ * @param pos The index at which to insert the child.
+ * @param child The child to insert.
+ * @return true on success, false if the children array could not be grown.
+ */
+static bool addRadixChild(RadixNode *node, int pos, RadixNode *child)
+{
+    // Grow the children array when it is full
+    if (node->childCount == node->childCapacity)
+    {
+        int newCapacity = node->childCapacity ? node->childCapacity * 2 : 2;
+        RadixNode **grown = (RadixNode **)realloc(node->children, newCapacity * sizeof(RadixNode *));
+        if (!grown)
+            return false;
+        COUNT_ALLOCATION();
+        node->children = grown;
+        node->childCapacity = newCapacity;
+    }
+    // Shift the larger children right to keep the array sorted
+    memmove(&node->children[pos + 1], &node->children[pos], (node->childCount - pos) * sizeof(RadixNode *));
+    node->children[pos] = child;
+    node->childCount++;
+    return true;
+}
+
+/**
+ * @brief Inserts a word into the radix tree, splitting edges where the word diverges.
+ * @param root The root node of the radix tree.
+ * @param word The word to insert.
+ */
+static void radixInsert(RadixNode *root, const char *word)
+{
+    const char *start = word; // Remember the whole word for the length index
+    RadixNode *node = root;
+    while (*word)
+    {
+        int pos;
+        RadixNode *child = findRadixChild(node, *word, &pos);
+        if (!child)
+        {
+            // No edge starts with this byte: the rest of the word becomes a single new leaf
+            RadixNode *leaf = createRadixNode(word, strlen(word));
+            if (!leaf)
+                return;
+            leaf->isEndOfWord = true;
+            if (!addRadixChild(node, pos, leaf))
+                free(leaf);
+            else
+                trackWordLength(start, 1);
+            return;
+        }
+
+        // Measure how much of the edge label matches the word
+        int common = 0;
+        while (common < child->labelLen && word[common] == child->label[common])
+            common++;
+
+        if (common < child->labelLen)
+        {
+            // The word leaves the edge part-way: split it at the point of divergence
+            RadixNode *mid = createRadixNode(child->label, common);
+            if (!mid || !addRadixChild(mid, 0, child))
+            {
+                free(mid);
+                return;
+            }
+            // The old child keeps only the part of its label after the split point
+            memmove(child->label, child->label + common, child->labelLen - common);
+            child->labelLen -= common;
+            node->children[pos] = mid;
+            child = mid;
+        }
+        // Consume the matched part of the word and move down
+        word += common;
+        node = child;
+    }
+    // The node where the word ends marks a complete word
+    if (!node->isEndOfWord)
+        trackWordLength(start, 1);
+    node->isEndOfWord = true;
+}
+
+/**
+ * @brief Searches for a prefix in the radix tree.
+ * The prefix may end in the middle of an edge; in that case the node below that edge is returned
+ * and the buffer is extended with the rest of the edge label.
+ * @param root The root node of the radix tree.
+ * @param prefix The prefix to search for.
+ * @param buffer Receives the full path from the root to the returned node.
+ * @param depth Receives the length of the path written to the buffer.
+ * @return The node where the prefix ends, or NULL if the prefix is not found.
+ */
+static RadixNode *radixSearchPrefix(RadixNode *root, const char *prefix, char *buffer, int *depth)
+{
+    METRIC_START(start);
+    RadixNode *node = root;
+    int len = 0;
+    int remaining = strlen(prefix);
+    while (remaining > 0)
+    {
+        METRIC_COUNT(queryNodes);
+        int pos;
+        RadixNode *child = findRadixChild(node, *prefix, &pos);
+        // Compare the prefix against as much of the edge label as it covers
+        int n = child && remaining < child->labelLen ? remaining : child ? child->labelLen : 0;
+        if (!child || memcmp(child->label, prefix, n) != 0)
+        {
+            node = NULL; // The prefix is not in the tree
+            break;
+        }
+        // Append the whole edge label to the path
+        memcpy(buffer + len, child->label, child->labelLen);
+        len += child->labelLen;
+        node = child;
+        if (remaining <= child->labelLen)
+            break; // The prefix ended inside (or exactly at the end of) this edge
+        prefix += child->labelLen;
+        remaining -= child->labelLen;
+    }
+    *depth = len;
+    METRIC_STOP(METRIC_SEARCH_PREFIX, start);
+    return node;
+}
+
+/**
+ * @brief Recursively collects all words below a radix tree node (DFS) and passes them to a sink.
+ * @param node The starting node for collection.
+ * @param buffer A character buffer holding the path to the node.
+ * @param depth The length of the path in the buffer.
+ * @param sink Called with every word, in alphabetical order.
+ * @param context Passed to the sink unchanged.
+ */
+static void radixCollectWords(RadixNode *node, char *buffer, int depth, WordSink sink, void *context)
+{
+    METRIC_COUNT(queryNodes);
+    if (node->isEndOfWord)
+    {
+        buffer[depth] = '\0';
+        METRIC_COUNT(queryWords);
+        sink(buffer, context);
+    }
+    // Children are sorted by first byte, so words come out in alphabetical order
+    for (int i = 0; i < node->childCount; i++)
+    {
+        RadixNode *child = node->children[i];
+        memcpy(buffer + depth, child->label, child->labelLen);
+        radixCollectWords(child, buffer, depth + child->labelLen, sink, context);
+    }
+}
+
+/**
+ * @brief Searches for a complete word in the radix tree.
+ * @param root The root of the radix tree.
+ * @param word The word to search for.
+ * @return true if the word exists, false otherwise.
+ */
+static bool radixSearchWord(RadixNode *root, const char *word)
+{
+    RadixNode *node = root;
+    while (*word)
+    {
+        int pos;
+        RadixNode *child = findRadixChild(node, *word, &pos);
+        // The whole edge label must match for the word to continue below it
+        if (!child || strncmp(word, child->label, child->labelLen) != 0)
+            return false;
+        word += child->labelLen;
+        node = child;
+    }
+    return node->isEndOfWord;
+}
+
+/**
+ * @brief Merges a child that no longer marks a word and has a single child with that grandchild.
+ * This keeps the tree path-compressed after deletions.
+ * @param parent The parent of the node to merge.
+ * @param pos The index of the node in the parent's children array.
+ */
+static void mergeRadixChild(RadixNode *parent, int pos)
+{
+    RadixNode *child = parent->children[pos];
+    RadixNode *grandchild = child->children[0];
+
+    // Build one node carrying both labels and the grandchild's contents
+    RadixNode *merged = createRadixNode(NULL, child->labelLen + grandchild->labelLen);
+    if (!merged)
+        return; // Leaving the tree uncompressed is still correct
+    memcpy(merged->label, child->label, child->labelLen);
+    memcpy(merged->label + child->labelLen, grandchild->label, grandchild->labelLen);
+    merged->children = grandchild->children;
+    merged->childCount = grandchild->childCount;
+    merged->childCapacity = grandchild->childCapacity;
+    merged->isEndOfWord = grandchild->isEndOfWord;
+
+    parent->children[pos] = merged;
+    free(child->children);
+    free(child);
+    free(grandchild); // Its children array now belongs to the merged node
+}
+
+/**
+ * @brief A recursive helper function to delete a word from the radix tree.
+ * @param node The current node in the traversal.
+ * @param word The remaining part of the word to delete.
+ * @return true if the parent node should delete the reference to this node.
+ */
+static bool radixDeleteHelper(RadixNode *node, const char *word)
+{
+    // If we have reached the end of the word
+    if (!*word)
+    {
+        if (!node->isEndOfWord)
+            return false;
+        node->isEndOfWord = false;
+        return node->childCount == 0;
+    }
+
+    int pos;
+    RadixNode *child = findRadixChild(node, *word, &pos);
+    if (!child || strncmp(word, child->label, child->labelLen) != 0)
+        return false; // The word is not in the tree
+
+    if (radixDeleteHelper(child, word + child->labelLen))
+    {
+        // Remove the child and close the gap in the sorted children array
+        destroyRadixTree(child);
+        memmove(&node->children[pos], &node->children[pos + 1], (node->childCount - pos - 1) * sizeof(RadixNode *));
+        node->childCount--;
+    }
+    else if (!child->isEndOfWord && child->childCount == 1)
+    {
+        // The child became a pass-through node, so fold it into its only child
+        mergeRadixChild(node, pos);
+    }
+    return !node->isEndOfWord && node->childCount == 0;
+}
+
+/**
+ * @brief Deletes a word from the radix tree and keeps the length index up to date.
+ * @param root The root node of the radix tree.
+ * @param word The word to delete.
+ */
+static void radixRemove(RadixNode *root, const char *word)
+{
+    if (!radixSearchWord(root, word))
+        return;
+    radixDeleteHelper(root, word);
+    trackWordLength(word, -1);
+}
+
+// --- BINARY SNAPSHOT FUNCTIONS ---
+
+/**
+ * @brief Returns the snapshot node stored at a given file offset.
+ * @param offset Byte offset of the node from the start of the snapshot.
+ * @return A pointer into the memory-mapped snapshot.
+ */
+static const SnapNode *snapNodeAt(uint32_t offset)
+{
+    return (const SnapNode *)(snapshot.base + offset);
+}
+
+/**
+ * @brief Returns the edge label bytes of a snapshot node (one byte per child).
+ * @param node The snapshot node.
+ * @return A pointer to the labels, which directly follow the node header.
+ */
+static const unsigned char *snapLabels(const SnapNode *node)
+{
+    return (const unsigned char *)(node + 1);
+}
+
+/**
+ * @brief Returns the child offsets of a snapshot node (parallel to its labels).
+ * @param node The snapshot node.
+ * @return A pointer to the offsets, which follow the labels padded to 4 bytes.
+ */
+static const uint32_t *snapChildOffsets(const SnapNode *node)
+{
+    return (const uint32_t *)(snapLabels(node) + SNAP_PAD(node->childCount));
+}
+
+/**
+ * @brief Recursively writes a Trie node and its subtree to the snapshot file in post-order.
+ * Children are written before their parent, so the parent can store their final offsets.
+ * @param file The snapshot file being written.
+ * @param node The Trie node to write.
+ * @param offset The current write offset; advanced past everything written.
+ * @return The file offset at which this node was written.
+ */
+static uint32_t writeSnapshotNode(FILE *file, TrieNode *node, uint32_t *offset)
+{
+    unsigned char labels[BYTE_VALUES] = {0};
+    uint32_t childOffsets[BYTE_VALUES];
+    int count = 0;
+
+    // Write every child subtree first and remember where each one ended up
+    TrieNode *child;
+    for (int byte = -1; (child = nextChild(node, &byte));)
+    {
+        labels[count] = byte;
+        childOffsets[count++] = writeSnapshotNode(file, child, offset);
+    }
+
+    // Now write this node: header, padded labels, then the child offsets
+    SnapNode header = {count, node->isEndOfWord, 0};
+    uint32_t nodeOffset = *offset;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(labels, 1, SNAP_PAD(count), file);
+    fwrite(childOffsets, sizeof(uint32_t), count, file);
+    *offset += sizeof(header) + SNAP_PAD(count) + count * sizeof(uint32_t);
+    return nodeOffset;
+}
+
+/**
+ * @brief Writes the whole Trie to the snapshot file.
+ * The snapshot is written to a temporary file first and renamed into place, so a crash
+ * never leaves a half-written snapshot behind.
+ * @param root The root node of the Trie.
+ * @return true if the snapshot was written successfully, false otherwise.
+ */
+bool writeSnapshot(TrieNode *root)
+{
+    FILE *file = fopen(SNAPSHOT_FILE ".tmp", "wb");
+    if (!file)
+        return false;
+
+    // Reserve space for the header; it is filled in once the root offset is known
+    SnapHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0, 0, wordLengths};
+    fwrite(&header, sizeof(header), 1, file);
+
+    uint32_t offset = sizeof(header);
+    header.rootOffset = writeSnapshotNode(file, root, &offset);
+    header.fileSize = offset;
+
+    // Go back and write the completed header
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok || rename(SNAPSHOT_FILE ".tmp", SNAPSHOT_FILE) != 0)
+    {
+        remove(SNAPSHOT_FILE ".tmp");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks whether the snapshot is newer than the text dictionary and its journal.
+ * @return true if the snapshot exists and was written after the dictionary last changed.
+ */
+bool isSnapshotFresh()
+{
+    struct stat dictStat, snapStat, journalStat;
+    if (stat(SNAPSHOT_FILE, &snapStat) != 0 || stat(DICTIONARY_FILE, &dictStat) != 0)
+        return false;
+    // Equal timestamps are treated as stale, because a same-second edit cannot be ruled out
+    if (stat(JOURNAL_FILE, &journalStat) == 0 && snapStat.st_mtime <= journalStat.st_mtime)
+        return false;
+    return snapStat.st_mtime > dictStat.st_mtime;
+}
+
+/**
+ * @brief Memory-maps the snapshot file so it can be queried without deserializing it.
+ * @return true if the snapshot was mapped and its header is valid, false otherwise.
+ */
+bool openSnapshot()
+{
+    int fd = open(SNAPSHOT_FILE, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid after the descriptor is closed
+    if (base == MAP_FAILED)
+        return false;
+
+    // Reject files that are not snapshots, were written by another version, or were truncated
+    const SnapHeader *header = (const SnapHeader *)base;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION ||
+        header->fileSize != (uint64_t)st.st_size ||
+        header->rootOffset < sizeof(SnapHeader) || header->rootOffset >= header->fileSize)
+    {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    snapshot.base = (const unsigned char *)base;
+    snapshot.size = st.st_size;
+    snapshot.rootOffset = header->rootOffset;
+    return true;
+}
+
+/**
+ * @brief Unmaps the snapshot if one is open.
+ */
+void closeSnapshot()
+{
+    if (snapshot.base)
+        munmap((void *)snapshot.base, snapshot.size);
+    snapshot.base = NULL;
+    snapshot.size = 0;
+}
+
+/**
+ * @brief Finds the child of a snapshot node reached by a given character.
+ * @param node The parent node.
+ * @param c The edge character.
+ * @return The child's offset, or 0 if there is no such child.
+ */
+static uint32_t snapChild(const SnapNode *node, char c)
+{
+    // Labels are sorted by byte value, so binary search them
+    const unsigned char *labels = snapLabels(node);
+    int low = 0, high = node->childCount - 1;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if (labels[mid] == (unsigned char)c)
+            return snapChildOffsets(node)[mid];
+        if (labels[mid] < (unsigned char)c)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return 0; // Offset 0 is the header, so it can never be a node
+}
+
+/**
+ * @brief Searches for a prefix in the snapshot.
+ * @param prefix The prefix to search for.
+ * @return The offset of the node where the prefix ends, or 0 if the prefix is not found.
+ */
+static uint32_t snapSearchPrefix(const char *prefix)
+{
+    METRIC_START(start);
+    uint32_t offset = snapshot.rootOffset;
+    while (*prefix && offset)
+    {
+        METRIC_COUNT(queryNodes);
+        offset = snapChild(snapNodeAt(offset), *prefix++);
+    }
+    METRIC_STOP(METRIC_SEARCH_PREFIX, start);
+    return offset;
+}
+
+/**
+ * @brief Searches for a complete word in the snapshot.
+ * @param word The word to search for.
+ * @return true if the word exists, false otherwise.
+ */
+static bool snapSearchWord(const char *word)
+{
+    uint32_t offset = snapSearchPrefix(word);
+    return offset && snapNodeAt(offset)->isEndOfWord;
+}
+
+/**
+ * @brief Recursively collects all words below a snapshot node (DFS) and passes them to a sink.
+ * @param offset The offset of the starting node.
+ * @param buffer A character buffer to build the current word.
+ * @param depth The current depth (length of the word in the buffer).
+ * @param sink Called with every word, in alphabetical order.
+ * @param context Passed to the sink unchanged.
+ */
+static void snapCollectWords(uint32_t offset, char *buffer, int depth, WordSink sink, void *context)
+{
+    METRIC_COUNT(queryNodes);
+    const SnapNode *node = snapNodeAt(offset);
+    if (node->isEndOfWord)
+    {
+        buffer[depth] = '\0';
+        METRIC_COUNT(queryWords);
+        sink(buffer, context);
+    }
+    // Labels were written in byte order, so words come out sorted
+    const unsigned char *labels = snapLabels(node);
+    const uint32_t *children = snapChildOffsets(node);
+    for (int i = 0; i < node->childCount; i++)
+    {
+        buffer[depth] = labels[i];
+        snapCollectWords(children[i], buffer, depth + 1, sink, context);
+    }
+}
+
+// --- DOUBLE-ARRAY TRIE FUNCTIONS ---
+
+/**
+ * @brief Frees the double array, if one is built.
+ * Queries of the double-array engine then go to the pointer Trie until it is rebuilt.
+ */
+void closeDoubleArray()
+{
+    free(doubleArray.cells);
+    free(doubleArray.links);
+    doubleArray.cells = NULL;
+    doubleArray.links = NULL;
+    doubleArray.size = 0;
+}
+
+/**
+ * @brief Removes a cell from the builder's free list.
+ * @param builder The builder.
+ * @param cell The cell.
+ */
+static void daUnlink(DaBuilder *builder, int32_t cell)
+{
+    if (builder->tries[cell] == DA_MAX_TRIES)
+        return; // Not in the list
+    builder->tries[cell] = DA_MAX_TRIES;
+    if (--builder->count == 0)
+    {
+        builder->head = -1;
+        return;
+    }
+    builder->next[builder->prev[cell]] = builder->next[cell];
+    builder->prev[builder->next[cell]] = builder->prev[cell];
+    if (builder->head == cell)
+        builder->head = builder->next[cell];
+}
+
+/**
+ * @brief Grows the double array under construction, adding the new cells to the free list.
+ * @param builder The builder.
+ * @param size The number of cells needed.
+ * @return true on success, false if memory ran out.
+ */
+static bool daGrow(DaBuilder *builder, uint32_t size)
+{
+    if (size <= doubleArray.size)
+        return true;
+    uint32_t capacity = doubleArray.size ? doubleArray.size : 1024;
+    while (capacity < size)
+        capacity *= 2;
+    if (capacity > DA_TERMINAL)
+        return false; // Bases must stay below the terminal bit
+
+    DaCell *cells = (DaCell *)realloc(doubleArray.cells, capacity * sizeof(DaCell));
+    if (cells)
+        doubleArray.cells = cells;
+    DaLinks *links = (DaLinks *)realloc(doubleArray.links, capacity * sizeof(DaLinks));
+    if (links)
+        doubleArray.links = links;
+    int32_t *next = (int32_t *)realloc(builder->next, capacity * sizeof(int32_t));
+    if (next)
+        builder->next = next;
+    int32_t *prev = (int32_t *)realloc(builder->prev, capacity * sizeof(int32_t));
+    if (prev)
+        builder->prev = prev;
+    unsigned char *tries = (unsigned char *)realloc(builder->tries, capacity);
+    if (tries)
+        builder->tries = tries;
+    if (!cells || !links || !next || !prev || !tries)
+        return false;
+    COUNT_ALLOCATION();
+    COUNT_ALLOCATION();
+
+    // Chain the new cells together and splice them in just before the head (at the end of the list)
+    for (uint32_t i = doubleArray.size; i < capacity; i++)
+    {
+        doubleArray.cells[i] = (DaCell){0, DA_FREE};
+        doubleArray.links[i] = (DaLinks){0, 0};
+        builder->tries[i] = 0;
+        builder->next[i] = i + 1;
+        builder->prev[i] = i - 1;
+    }
+    int32_t first = doubleArray.size, last = capacity - 1;
+    if (builder->head < 0)
+    {
+        builder->head = first;
+        builder->prev[first] = last;
+        builder->next[last] = first;
+    }
+    else
+    {
+        int32_t tail = builder->prev[builder->head];
+        builder->next[tail] = first;
+        builder->prev[first] = tail;
+        builder->next[last] = builder->head;
+        builder->prev[builder->head] = last;
+    }
+    builder->count += capacity - doubleArray.size;
+    doubleArray.size = capacity;
+    return true;
+}
+
+/**
+ * @brief Finds a base at which every child byte of a node lands on a free cell.
+ * Free cells are tried in list order as the slot of the first child; a cell that keeps failing
+ * leaves the list, so dense regions are not searched again and again.
+ * @param builder The builder.
+ * @param bytes The child bytes, in increasing order.
+ * @param count The number of child bytes (at least one).
+ * @param base Receives the base.
+ * @return true on success, false if memory ran out.
+ */
+static bool daFindBase(DaBuilder *builder, const unsigned char *bytes, int count, uint32_t *base)
+{
+    for (;;)
+    {
+        int32_t cell = builder->head;
+        for (uint32_t visited = 0, listed = builder->count; visited < listed && cell >= 0; visited++)
+        {
+            uint32_t candidate = cell - bytes[0];
+            if ((uint32_t)cell >= bytes[0])
+            {
+                // Keep a full byte range after the base inside the array
+                if (!daGrow(builder, candidate + BYTE_VALUES))
+                    return false;
+                int i = 1;
+                while (i < count && doubleArray.cells[candidate + bytes[i]].check == DA_FREE)
+                    i++;
+                if (i == count)
+                {
+                    *base = candidate;
+                    return true;
+                }
+            }
+            int32_t next = builder->next[cell];
+            if (++builder->tries[cell] == DA_MAX_TRIES)
+            {
+                builder->tries[cell]--;
+                daUnlink(builder, cell);
+            }
+            cell = next;
+        }
+        // No free cell fits: add fresh cells at the end, where any set of bytes fits
+        if (!daGrow(builder, doubleArray.size * 2))
+            return false;
+    }
+}
+
+/**
+ * @brief Recursively places the children of a Trie node in the double array.
+ * @param builder The builder.
+ * @param node The Trie node.
+ * @param index The cell of the node.
+ * @return true on success, false if memory ran out.
+ */
+static bool daPlaceChildren(DaBuilder *builder, TrieNode *node, uint32_t index)
+{
+    unsigned char bytes[BYTE_VALUES];
+    TrieNode *children[BYTE_VALUES];
+    int count = 0;
+    TrieNode *child;
+    for (int byte = -1; (child = nextChild(node, &byte));)
+    {
+        bytes[count] = byte;
+        children[count++] = child;
+    }
+
+    uint32_t base = 0;
+    if (count && !daFindBase(builder, bytes, count, &base))
+        return false;
+    doubleArray.cells[index].base = base | (node->isEndOfWord ? DA_TERMINAL : 0);
+    doubleArray.links[index].firstChild = count ? bytes[0] : 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t cell = base + bytes[i];
+        daUnlink(builder, cell);
+        doubleArray.cells[cell].check = index;
+        doubleArray.links[cell].nextSibling = i + 1 < count ? bytes[i + 1] : 0;
+        if (cell >= builder->used)
+            builder->used = cell + 1;
+    }
+    for (int i = 0; i < count; i++)
+        if (!daPlaceChildren(builder, children[i], base + bytes[i]))
+            return false;
+    return true;
+}
+
+/**
+ * @brief Compiles the pointer Trie into a double-array trie (BASE/CHECK arrays).
+ * Every step of a lookup then reads two array entries instead of following a pointer.
+ * Any previous double array is replaced. The Trie itself is kept: the double array is
+ * read-only, so updates go to the Trie and drop the double array until it is rebuilt.
+ * @param root The root node of the Trie.
+ * @return true on success, false if memory ran out (the queries then use the Trie).
+ */
+bool buildDoubleArray(TrieNode *root)
+{
+    closeDoubleArray();
+    DaBuilder builder = {NULL, NULL, NULL, -1, 0, 1};
+    bool ok = daGrow(&builder, BYTE_VALUES);
+    if (ok)
+    {
+        // The root is cell 0; it never is a child, since every edge byte is at least 1
+        daUnlink(&builder, 0);
+        doubleArray.cells[0].check = 0;
+        ok = daPlaceChildren(&builder, root, 0);
+    }
+    free(builder.next);
+    free(builder.prev);
+    free(builder.tries);
+    if (!ok)
+    {
+        closeDoubleArray();
+        return false;
+    }
+
+    // Drop the unused tail, keeping a full byte range after the last cell in use
+    uint32_t size = builder.used + BYTE_VALUES;
+    if (size < doubleArray.size)
+    {
+        DaCell *cells = (DaCell *)realloc(doubleArray.cells, size * sizeof(DaCell));
+        DaLinks *links = (DaLinks *)realloc(doubleArray.links, size * sizeof(DaLinks));
+        if (cells)
+            doubleArray.cells = cells;
+        if (links)
+            doubleArray.links = links;
+        if (cells && links)
+            doubleArray.size = size;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the child of a double-array node reached by a given byte.
+ * @param node The parent cell.
+ * @param c The edge byte.
+ * @return The child's cell, or DA_NONE if there is no such child.
+ */
+static uint32_t daChild(uint32_t node, char c)
+{
+    uint32_t cell = (doubleArray.cells[node].base & ~DA_TERMINAL) + (unsigned char)c;
+    return doubleArray.cells[cell].check == node ? cell : DA_NONE;
+}
+
+/**
+ * @brief Searches for a prefix in the double array.
+ * @param prefix The prefix to search for.
+ * @return The cell where the prefix ends, or DA_NONE if the prefix is not found.
+ */
+static uint32_t daSearchPrefix(const char *prefix)
+{
+    METRIC_START(start);
+    uint32_t node = 0;
+    while (*prefix && node != DA_NONE)
+    {
+        METRIC_COUNT(queryNodes);
+        node = daChild(node, *prefix++);
+    }
+    METRIC_STOP(METRIC_SEARCH_PREFIX, start);
+    return node;
+}
+
+/**
+ * @brief Searches for a complete word in the double array.
+ * @param word The word to search for.
+ * @return true if the word exists, false otherwise.
+ */
+static bool daSearchWord(const char *word)
+{
+    uint32_t node = daSearchPrefix(word);
+    return node != DA_NONE && (doubleArray.cells[node].base & DA_TERMINAL);
+}
+
+/**
+ * @brief Recursively collects all words below a double-array node (DFS) and passes them to a sink.
+ * @param node The cell of the starting node.
+ * @param buffer A character buffer to build the current word.
+ * @param depth The current depth (length of the word in the buffer).
+ * @param sink Called with every word, in alphabetical order.
+ * @param context Passed to the sink unchanged.
+ */
+static void daCollectWords(uint32_t node, char *buffer, int depth, WordSink sink, void *context)
+{
+    METRIC_COUNT(queryNodes);
+    uint32_t base = doubleArray.cells[node].base;
+    if (base & DA_TERMINAL)
+    {
+        buffer[depth] = '\0';
+        METRIC_COUNT(queryWords);
+        sink(buffer, context);
+    }
+    // Siblings were linked in byte order, so words come out sorted
+    base &= ~DA_TERMINAL;
+    for (unsigned char c = doubleArray.links[node].firstChild; c; c = doubleArray.links[base + c].nextSibling)
+    {
+        buffer[depth] = c;
+        daCollectWords(base + c, buffer, depth + 1, sink, context);
+    }
+}
+
+// --- SUBSTRING (TRIGRAM) INDEX ---
+
+/**
+ * @brief Packs three bytes of a word into a trigram key.
+ * @param p The first of the three bytes (none of them is the terminating NUL).
+ * @return The trigram key (never 0).
+ */
+static uint32_t packGram(const char *p)
+{
+    return (uint32_t)(unsigned char)p[0] << 16 | (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+/**
+ * @brief Finds the posting list of a trigram (linear probing).
+ * @param gram The trigram key.
+ * @return The slot holding the trigram, or the empty slot where it would be inserted.
+ */
+static PostingList *findGramSlot(uint32_t gram)
+{
+    size_t mask = substringIndex.gramCapacity - 1; // The capacity is always a power of two
+    size_t i = (size_t)((gram * 0x9E3779B97F4A7C15ULL) >> 32) & mask; // Fibonacci hashing spreads neighbouring trigrams
+    while (substringIndex.grams[i].gram && substringIndex.grams[i].gram != gram)
+        i = (i + 1) & mask;
+    return &substringIndex.grams[i];
+}
+
+/**
+ * @brief Looks up the posting list of a trigram.
+ * @param gram The trigram key.
+ * @return The list, or NULL if no indexed word contains the trigram.
+ */
+static PostingList *lookupGram(uint32_t gram)
+{
+    if (!substringIndex.gramCapacity)
+        return NULL;
+    PostingList *list = findGramSlot(gram);
+    return list->gram ? list : NULL;
+}
+
+/**
+ * @brief Doubles the trigram table and moves every posting list to its new slot.
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool growGramTable()
+{
+    size_t oldCapacity = substringIndex.gramCapacity;
+    PostingList *oldGrams = substringIndex.grams;
+    size_t newCapacity = oldCapacity ? oldCapacity * 2 : GRAM_TABLE_INITIAL_CAPACITY;
+    PostingList *grams = (PostingList *)calloc(newCapacity, sizeof(PostingList));
+    if (!grams)
+        return false;
+    COUNT_ALLOCATION();
+    substringIndex.grams = grams;
+    substringIndex.gramCapacity = newCapacity;
+    for (size_t i = 0; i < oldCapacity; i++)
+        if (oldGrams[i].gram)
+            *findGramSlot(oldGrams[i].gram) = oldGrams[i];
+    free(oldGrams);
+    return true;
+}
+
+/**
+ * @brief Appends a word id to a posting list (ids arrive in increasing order, so the list stays sorted).
+ * @param list The posting list.
+ * @param id The word id; ignored if it is the last one already (a trigram repeated within the word).
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool appendPosting(PostingList *list, uint32_t id)
+{
+    if (list->count && list->ids[list->count - 1] == id)
+        return true;
+    if (list->count == list->capacity)
+    {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 2;
+        uint32_t *ids = (uint32_t *)realloc(list->ids, capacity * sizeof(uint32_t));
+        if (!ids)
+            return false;
+        COUNT_ALLOCATION();
+        list->ids = ids;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = id;
+    return true;
+}
+
+/**
+ * @brief Drops the deleted ids from a posting list and renumbers the others.
+ * @param list The posting list.
+ * @param renumbered New id of every old id (meaningless for deleted ones).
+ */
+static void compactPostings(PostingList *list, const uint32_t *renumbered)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < list->count; i++)
+        if (substringIndex.words[list->ids[i]])
+            list->ids[kept++] = renumbered[list->ids[i]];
+    list->count = kept;
+    if (kept == 0)
+    {
+        // The slot stays (linear probing has no deletion), but its array goes
+        free(list->ids);
+        list->ids = NULL;
+        list->capacity = 0;
+    }
+}
+
+/**
+ * @brief Returns the posting list of a word's or fragment's first byte pair, or of its only byte.
+ * @param p The first byte.
+ * @param len 1 for the byte's list, 2 for the pair's list.
+ * @return The list (NULL before any word was posted).
+ */
+static PostingList *shortGramList(const char *p, size_t len)
+{
+    if (!substringIndex.bigrams)
+        return NULL;
+    if (len == 1)
+        return &substringIndex.unigrams[(unsigned char)p[0]];
+    return &substringIndex.bigrams[(unsigned char)p[0] << 8 | (unsigned char)p[1]];
+}
+
+/**
+ * @brief Picks the posting list a word or fragment must appear in with the fewest ids:
+ * the rarest of its trigrams, or the list of its byte pair or byte when it is shorter than a trigram.
+ * @param word The word or fragment (not empty).
+ * @param len Its length in bytes.
+ * @return The list, or NULL if one of its grams is in no indexed word.
+ */
+static PostingList *rarestPostingList(const char *word, size_t len)
+{
+    if (len < 3)
+    {
+        PostingList *list = shortGramList(word, len);
+        return list && list->count ? list : NULL;
+    }
+    PostingList *rarest = NULL;
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        PostingList *list = lookupGram(packGram(word + i));
+        if (!list)
+            return NULL;
+        if (!rarest || list->count < rarest->count)
+            rarest = list;
+    }
+    return rarest;
+}
+
+/**
+ * @brief Finds the id of an indexed word by scanning the rarest posting list it must be in.
+ * @param word The word.
+ * @return Its id, or UINT32_MAX if it is not indexed.
+ */
+static uint32_t findIndexedWord(const char *word)
+{
+    PostingList *list = rarestPostingList(word, strlen(word));
+    for (uint32_t i = 0; list && i < list->count; i++)
+    {
+        const char *indexed = substringIndex.words[list->ids[i]];
+        if (indexed && strcmp(indexed, word) == 0)
+            return list->ids[i];
+    }
+    return UINT32_MAX;
+}
+
+/**
+ * @brief Adds the bytes, byte pairs and trigrams of a stored word to the posting lists.
+ * @param id The id of the word (higher than every id posted before).
+ */
+static void postIndexedWord(uint32_t id)
+{
+    const char *word = substringIndex.words[id];
+    size_t len = strlen(word);
+    if (!substringIndex.bigrams)
+    {
+        // Allocated together with the first word, so an unused index stays small
+        substringIndex.unigrams = (PostingList *)calloc(BYTE_VALUES, sizeof(PostingList));
+        substringIndex.bigrams = (PostingList *)calloc(BYTE_VALUES * BYTE_VALUES, sizeof(PostingList));
+        if (!substringIndex.unigrams || !substringIndex.bigrams)
+        {
+            free(substringIndex.unigrams);
+            free(substringIndex.bigrams);
+            substringIndex.unigrams = substringIndex.bigrams = NULL;
+            return;
+        }
+        COUNT_ALLOCATION();
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        appendPosting(shortGramList(word + i, 1), id);
+        if (i + 2 <= len)
+            appendPosting(shortGramList(word + i, 2), id);
+    }
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        // Keep the load factor below 3/4 so probe sequences stay short
+        if ((substringIndex.gramCount + 1) * 4 > substringIndex.gramCapacity * 3 && !growGramTable())
+            return;
+        uint32_t gram = packGram(word + i);
+        PostingList *list = findGramSlot(gram);
+        if (!list->gram)
+        {
+            list->gram = gram;
+            substringIndex.gramCount++;
+        }
+        appendPosting(list, id);
+    }
+}
+
+/**
+ * @brief Posts the trigrams of every word stored while postings were deferred, then posts new words right away again.
+ * One pass over many words keeps the posting lists in cache, instead of interleaving them with the loader's work.
+ */
+static void postPendingWords()
+{
+    for (; substringIndex.postedCount < substringIndex.wordCount; substringIndex.postedCount++)
+        if (substringIndex.words[substringIndex.postedCount])
+            postIndexedWord(substringIndex.postedCount);
+    substringIndex.deferPostings = false;
+}
+
+/**
+ * @brief Copies a word into a chain of word blocks, starting a new block when the newest one is full.
+ * @param blocks The chain (newest block first).
+ * @param word The word.
+ * @return The copy, or NULL if memory could not be allocated.
+ */
+static char *storeIndexedWord(WordBlock **blocks, const char *word)
+{
+    size_t len = strlen(word);
+    WordBlock *block = *blocks;
+    if (!block || block->used + len + 1 > WORD_BLOCK_SIZE)
+    {
+        block = (WordBlock *)malloc(sizeof(WordBlock));
+        if (!block)
+            return NULL;
+        COUNT_ALLOCATION();
+        block->next = *blocks;
+        block->used = 0;
+        *blocks = block;
+    }
+    char *copy = block->text + block->used;
+    block->used += len + 1;
+    memcpy(copy, word, len + 1);
+    return copy;
+}
+
+/**
+ * @brief Frees a chain of word blocks.
+ * @param block The newest block of the chain.
+ */
+static void freeWordBlocks(WordBlock *block)
+{
+    while (block)
+    {
+        WordBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+/**
+ * @brief Adds a word that is not indexed yet under a new id.
+ * Its trigrams are posted at once, or by postPendingWords() while postings are deferred.
+ * @param word The word.
+ */
+static void addIndexedWord(const char *word)
+{
+    if (substringIndex.wordCount == substringIndex.wordCapacity)
+    {
+        uint32_t capacity = substringIndex.wordCapacity ? substringIndex.wordCapacity * 2 : 1024;
+        char **words = (char **)realloc(substringIndex.words, capacity * sizeof(char *));
+        if (!words)
+            return;
+        COUNT_ALLOCATION();
+        substringIndex.words = words;
+        substringIndex.wordCapacity = capacity;
+    }
+    char *copy = storeIndexedWord(&substringIndex.blocks, word);
+    if (!copy)
+        return;
+    substringIndex.words[substringIndex.wordCount++] = copy;
+    if (!substringIndex.deferPostings)
+        postPendingWords();
+}
+
+/**
+ * @brief Word sink that adds every word of the dictionary to the substring index.
+ * @param word The word.
+ * @param context Unused.
+ */
+static void indexWordSink(const char *word, void *context)
+{
+    (void)context;
+    addIndexedWord(word);
+}
+
+/**
+ * @brief Frees the substring index; it is rebuilt by the next load or substring query.
+ */
+void freeSubstringIndex()
+{
+    freeWordBlocks(substringIndex.blocks);
+    for (size_t i = 0; i < substringIndex.gramCapacity; i++)
+        free(substringIndex.grams[i].ids);
+    free(substringIndex.words);
+    free(substringIndex.grams);
+    for (int i = 0; substringIndex.bigrams && i < BYTE_VALUES * BYTE_VALUES; i++)
+    {
+        if (i < BYTE_VALUES)
+            free(substringIndex.unigrams[i].ids);
+        free(substringIndex.bigrams[i].ids);
+    }
+    free(substringIndex.unigrams);
+    free(substringIndex.bigrams);
+    memset(&substringIndex, 0, sizeof(substringIndex));
+}
+
+/**
+ * @brief Drops the deleted words from the substring index, so its memory follows the live dictionary
+ * rather than every word it ever held. The live words get consecutive ids in their old order (so the
+ * posting lists stay sorted) and their text is copied into fresh blocks.
+ * @return true on success, false if memory ran out (the index is left as it was).
+ */
+static bool compactSubstringIndex()
+{
+    uint32_t live = substringIndex.wordCount - substringIndex.deletedCount;
+    uint32_t capacity = live > 1024 ? live : 1024;
+    uint32_t *renumbered = (uint32_t *)malloc(substringIndex.wordCount * sizeof(uint32_t));
+    char **words = (char **)malloc(capacity * sizeof(char *));
+    WordBlock *blocks = NULL;
+    bool ok = renumbered && words;
+    uint32_t next = 0;
+    for (uint32_t id = 0; ok && id < substringIndex.wordCount; id++)
+    {
+        if (!substringIndex.words[id])
+            continue;
+        renumbered[id] = next;
+        words[next] = storeIndexedWord(&blocks, substringIndex.words[id]);
+        ok = words[next++] != NULL;
+    }
+    if (!ok)
+    {
+        free(renumbered);
+        free(words);
+        freeWordBlocks(blocks);
+        return false;
+    }
+    COUNT_ALLOCATION();
+
+    // Nothing below allocates, so the index cannot be left half compacted
+    for (int i = 0; substringIndex.bigrams && i < BYTE_VALUES * BYTE_VALUES; i++)
+    {
+        if (i < BYTE_VALUES)
+            compactPostings(&substringIndex.unigrams[i], renumbered);
+        compactPostings(&substringIndex.bigrams[i], renumbered);
+    }
+    for (size_t i = 0; i < substringIndex.gramCapacity; i++)
+        if (substringIndex.grams[i].gram)
+            compactPostings(&substringIndex.grams[i], renumbered);
+    free(renumbered);
+    free(substringIndex.words);
+    freeWordBlocks(substringIndex.blocks);
+    substringIndex.words = words;
+    substringIndex.wordCapacity = capacity;
+    substringIndex.blocks = blocks;
+    substringIndex.wordCount = substringIndex.postedCount = live;
+    substringIndex.deletedCount = 0;
+    return true;
+}
+
+/**
+ * @brief Removes a deleted word from the substring index.
+ * Its id only becomes a tombstone that queries skip, since removing it from every posting list would
+ * shift each of them; once INDEX_COMPACT_MIN tombstones make up a quarter of the ids, the index is compacted.
+ * @param word The word.
+ */
+static void unindexWord(const char *word)
+{
+    uint32_t id = findIndexedWord(word);
+    if (id == UINT32_MAX)
+        return;
+    substringIndex.words[id] = NULL;
+    substringIndex.deletedCount++;
+    if (!substringIndex.deferPostings && substringIndex.deletedCount >= INDEX_COMPACT_MIN &&
+        substringIndex.deletedCount >= substringIndex.wordCount / 4)
+        compactSubstringIndex();
+}
+
+// --- PREFIX RESULT CACHE ---
+
+/**
+ * @brief Finds the cache entry of a prefix given by its first bytes.
+ * @param prefix The prefix (only its first len bytes are used, so the prefixes of a word need no copies).
+ * @param len The length of the prefix in bytes.
+ * @param hash hashWord() of those bytes.
+ * @return The entry, or NULL if the prefix is not cached.
+ */
+static PrefixCacheEntry *findPrefixEntry(const char *prefix, size_t len, uint64_t hash)
+{
+    for (PrefixCacheEntry *entry = prefixCache.buckets[hash & (PREFIX_CACHE_BUCKETS - 1)]; entry; entry = entry->chain)
+        if (entry->hash == hash && strncmp(entry->prefix, prefix, len) == 0 && !entry->prefix[len])
+            return entry;
+    return NULL;
+}
+
+/**
+ * @brief Unlinks an entry from the least-recently-used list.
+ * @param entry The entry.
+ */
+static void unlinkRecency(PrefixCacheEntry *entry)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        prefixCache.newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        prefixCache.oldest = entry->newer;
+}
+
+/**
+ * @brief Links an entry at the most recently used end of the list.
+ * @param entry The entry (not in the list).
+ */
+static void linkNewest(PrefixCacheEntry *entry)
+{
+    entry->newer = NULL;
+    entry->older = prefixCache.newest;
+    if (prefixCache.newest)
+        prefixCache.newest->newer = entry;
+    else
+        prefixCache.oldest = entry;
+    prefixCache.newest = entry;
+}
+
+/**
+ * @brief Removes an entry from the cache and frees it.
+ * @param entry The entry.
+ */
+static void dropPrefixEntry(PrefixCacheEntry *entry)
+{
+    PrefixCacheEntry **link = &prefixCache.buckets[entry->hash & (PREFIX_CACHE_BUCKETS - 1)];
+    while (*link != entry)
+        link = &(*link)->chain;
+    *link = entry->chain;
+    unlinkRecency(entry);
+    prefixCache.entries--;
+    prefixCache.bytes -= entry->bytes;
+    free(entry->words);
+    free(entry);
+}
+
+/**
+ * @brief Drops the cached completion lists a word belongs to, after it was inserted or deleted.
+ * Those are exactly the entries of the word's prefixes, the empty prefix and the word itself included;
+ * every other entry stays valid. FNV-1a is computed byte by byte, so each prefix's hash costs one step.
+ * @param word The word that changed.
+ */
+static void invalidatePrefixCache(const char *word)
+{
+    if (!prefixCache.entries)
+        return;
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t len = 0;; len++)
+    {
+        PrefixCacheEntry *entry = findPrefixEntry(word, len, hash);
+        if (entry)
+        {
+            dropPrefixEntry(entry);
+            prefixCache.invalidations++;
+        }
+        if (!word[len])
+            break;
+        hash = (hash ^ (unsigned char)word[len]) * FNV_PRIME;
+    }
+}
+
+/**
+ * @brief Empties the prefix result cache (its counters are kept).
+ */
+void clearPrefixCache()
+{
+    while (prefixCache.oldest)
+        dropPrefixEntry(prefixCache.oldest);
+}
+
+// --- JOURNAL AND WRITE-BEHIND PERSISTENCE ---
+
+/**
+ * @brief Opens the mutation journal for appending, if it is not open already.
+ * @return true if the journal is open, false otherwise.
+ */
+static bool openJournal()
+{
+    if (!journal)
+        journal = fopen(JOURNAL_FILE, "a");
+    return journal != NULL;
+}
+
+/**
+ * @brief Flushes the journal and forces it to disk.
+ * @return true if the records written so far are on disk.
+ */
+static bool syncJournal()
+{
+    if (!journal)
+        return true;
+    journalUnsynced = 0;
+    return fflush(journal) == 0 && fsync(fileno(journal)) == 0;
+}
+
+/**
+ * @brief Closes the journal after forcing any pending records to disk.
+ */
+void closeJournal()
+{
+    if (!journal)
+        return;
+    syncJournal();
+    fclose(journal);
+    journal = NULL;
+}
+
+/**
+ * @brief Counts one more write in the queue and wakes the write-behind thread for the first write of
+ * a batch (to start its interval) and when PERSIST_BATCH writes are waiting. The queue lock must be held.
+ */
+static void countQueuedWrite()
+{
+    writeBehind.queued++;
+    if (writeBehind.count++ == 0)
+        writeBehind.firstQueuedAt = nowNanoseconds();
+    if (writeBehind.count == 1 || writeBehind.count == PERSIST_BATCH)
+        pthread_cond_signal(&writeBehind.wake);
+}
+
+/**
+ * @brief Queues a journal record for the write-behind thread.
+ * Only the queue lock is taken, never the disk.
+ * @param op '+' for an added word, '-' for a deleted one.
+ * @param word The word concerned.
+ * @return true if the record was queued, false if write-behind is off or memory ran out (the caller writes it itself).
+ */
+static bool queueWrite(char op, const char *word)
+{
+    if (!writeBehind.running)
+        return false;
+    size_t len = strlen(word) + 1;
+    PendingWrite *write = (PendingWrite *)malloc(sizeof(PendingWrite) + len);
+    if (!write)
+        return false;
+    write->next = NULL;
+    write->op = op;
+    memcpy(write->word, word, len);
+
+    pthread_mutex_lock(&writeBehind.lock);
+    write->sequence = writeBehind.queued;
+    *writeBehind.tail = write;
+    writeBehind.tail = &write->next;
+    countQueuedWrite();
+    pthread_mutex_unlock(&writeBehind.lock);
+    return true;
+}
+
+/**
+ * @brief Hands the unsaved searches to the write-behind thread as one block of "word delta" lines.
+ * Runs on the thread that counts searches, so the statistics table needs no lock; only the hand-off
+ * takes the queue lock, once per batch of words rather than once per search.
+ * @return true if nothing is left unsaved, false if write-behind is off or memory ran out (they stay unsaved).
+ */
+static bool handOffSearchCounts()
+{
+    if (searchStats.unsavedCount == 0)
+        return true;
+    if (!writeBehind.running)
+        return false;
+    size_t size = 1;
+    for (size_t i = 0; i < searchStats.unsavedCount; i++)
+        size += strlen(searchStats.unsaved[i]) + 13; // A space, up to 11 characters of count and a newline
+    char *lines = (char *)malloc(size);
+    if (!lines)
+        return false;
+    size_t length = 0;
+    for (size_t i = 0; i < searchStats.unsavedCount; i++)
+    {
+        const char *word = searchStats.unsaved[i];
+        WordFrequency *slot = findStatsSlot(word, hashWord(word));
+        length += sprintf(lines + length, "%s %d\n", word, slot->unsaved);
+        slot->unsaved = 0;
+    }
+    searchStats.unsavedCount = 0;
+
+    pthread_mutex_lock(&writeBehind.lock);
+    if (writeBehind.statsLines)
+    {
+        // The thread has not taken the previous block yet: extend it (it is already counted in the queue)
+        char *joined = (char *)realloc(writeBehind.statsLines, writeBehind.statsLength + length + 1);
+        if (joined)
+        {
+            memcpy(joined + writeBehind.statsLength, lines, length + 1);
+            writeBehind.statsLines = joined;
+            writeBehind.statsLength += length;
+        }
+        else
+            writeBehind.failures++; // The totals still reach the file with the next saveSearchStats
+        free(lines);
+    }
+    else
+    {
+        writeBehind.statsLines = lines;
+        writeBehind.statsLength = length;
+        countQueuedWrite();
+    }
+    pthread_mutex_unlock(&writeBehind.lock);
+    return true;
+}
+
+/**
+ * @brief Orders two queued journal records by word, then queue order.
+ * @param a The first write.
+ * @param b The second write.
+ * @return Negative, zero or positive, like strcmp.
+ */
+static int comparePendingWrites(const PendingWrite *a, const PendingWrite *b)
+{
+    int order = strcmp(a->word, b->word);
+    if (order == 0)
+        order = (a->sequence > b->sequence) - (a->sequence < b->sequence);
+    return order;
+}
+
+/**
+ * @brief Sorts a list of queued writes with comparePendingWrites (merge sort, so it needs no memory).
+ * @param list The first write of the list.
+ * @param count The number of writes in the list.
+ * @return The first write of the sorted list.
+ */
+static PendingWrite *sortPendingWrites(PendingWrite *list, int count)
+{
+    if (count < 2)
+        return list;
+    PendingWrite *middle = list;
+    for (int i = 1; i < count / 2; i++)
+        middle = middle->next;
+    PendingWrite *a = sortPendingWrites(middle->next, count - count / 2);
+    middle->next = NULL;
+    PendingWrite *b = sortPendingWrites(list, count / 2); // The first half wins ties, keeping queue order
+
+    PendingWrite *head = NULL, **tail = &head;
+    while (a && b)
+    {
+        PendingWrite **smaller = comparePendingWrites(b, a) <= 0 ? &b : &a;
+        *tail = *smaller;
+        tail = &(*smaller)->next;
+        *smaller = (*smaller)->next;
+    }
+    *tail = a ? a : b;
+    return head;
+}
+
+/**
+ * @brief Writes out (and frees) a batch taken off the write-behind queue.
+ * Journal records are coalesced per word: only the last one of a word is kept, since it alone
+ * decides whether the word is in the dictionary. The search count lines are appended as they are
+ * (loadSearchStats adds repeated words together). Each file is forced to disk once.
+ * @param batch The first journal record of the batch (NULL if there is none).
+ * @param count The number of journal records in the batch.
+ * @param statsLines Search count lines to append to the stats file (NULL if there are none); freed here.
+ * @param statsLength The number of bytes in statsLines.
+ * @return true if everything reached the disk.
+ */
+static bool writePendingBatch(PendingWrite *batch, int count, char *statsLines, size_t statsLength)
+{
+    bool ok = true, journalWritten = false;
+    PendingWrite *write = sortPendingWrites(batch, count);
+    while (write)
+    {
+        // Skip to the last record of the run for the same word
+        PendingWrite *last = write;
+        while (last->next && strcmp(last->next->word, write->word) == 0)
+            last = last->next;
+
+        if (openJournal() && fprintf(journal, "%c%s\n", last->op, write->word) > 0)
+            journalWritten = true;
+        else
+            ok = false;
+
+        PendingWrite *next = last->next;
+        while (write != next)
+        {
+            PendingWrite *done = write;
+            write = write->next;
+            free(done);
+        }
+    }
+    if (journalWritten)
+        ok = syncJournal() && ok;
+
+    if (statsLines)
+    {
+        FILE *stats = fopen(STATS_FILE, "a");
+        bool written = stats && fwrite(statsLines, 1, statsLength, stats) == statsLength;
+        written = stats && fflush(stats) == 0 && fsync(fileno(stats)) == 0 && written;
+        if (stats)
+            written = fclose(stats) == 0 && written;
+        ok = written && ok;
+        free(statsLines);
+    }
+    return ok;
+}
+
+/**
+ * @brief Body of the write-behind thread: flushes the queue once PERSIST_BATCH writes are waiting,
+ * the oldest one has waited PERSIST_INTERVAL_MS, or a caller drains or stops it.
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *runWriteBehind(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&writeBehind.lock);
+    for (;;)
+    {
+        while (!writeBehind.stopping && !writeBehind.urgent && writeBehind.count < PERSIST_BATCH)
+        {
+            if (writeBehind.count == 0)
+            {
+                pthread_cond_wait(&writeBehind.wake, &writeBehind.lock);
+                continue;
+            }
+            uint64_t deadline = writeBehind.firstQueuedAt + PERSIST_INTERVAL_MS * 1000000ULL;
+            if (nowNanoseconds() >= deadline)
+                break;
+            struct timespec until = {(time_t)(deadline / 1000000000ULL), (long)(deadline % 1000000000ULL)};
+            pthread_cond_timedwait(&writeBehind.wake, &writeBehind.lock, &until); // The condition uses CLOCK_MONOTONIC
+        }
+        if (writeBehind.count == 0 && writeBehind.stopping)
+            break;
+
+        // Take the whole queue, so new writes are queued while this batch is on its way to disk
+        PendingWrite *batch = writeBehind.head;
+        int count = writeBehind.count;
+        int records = count - (writeBehind.statsLines != NULL);
+        char *statsLines = writeBehind.statsLines;
+        size_t statsLength = writeBehind.statsLength;
+        writeBehind.head = NULL;
+        writeBehind.tail = &writeBehind.head;
+        writeBehind.statsLines = NULL;
+        writeBehind.statsLength = 0;
+        writeBehind.count = 0;
+        writeBehind.urgent = false;
+        pthread_mutex_unlock(&writeBehind.lock);
+
+        bool ok = writePendingBatch(batch, records, statsLines, statsLength);
+
+        pthread_mutex_lock(&writeBehind.lock);
+        writeBehind.written += count;
+        if (!ok)
+            writeBehind.failures++; // Reported through persistenceFailures(), not to whoever queues next
+        pthread_cond_broadcast(&writeBehind.flushed);
+    }
+    pthread_mutex_unlock(&writeBehind.lock);
+    return NULL;
+}
+
+/**
+ * @brief Starts the write-behind thread: from now on journal records and exact search counts are
+ * queued and written in the background, so adding, deleting and searching never wait for the disk.
+ * A crash loses at most the journal records of the last PERSIST_INTERVAL_MS. Searches are handed over
+ * by the first search after PERSIST_INTERVAL_MS (or PERSIST_BATCH new words), so a crash can also
+ * lose the searches made since the last hand-off.
+ * @return true if the thread runs (writes stay synchronous otherwise).
+ */
+bool startPersistence()
+{
+    if (writeBehind.running)
+        return true;
+    pthread_condattr_t monotonic;
+    pthread_condattr_init(&monotonic);
+    pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC); // Deadlines come from nowNanoseconds()
+    pthread_cond_init(&writeBehind.wake, &monotonic);
+    pthread_condattr_destroy(&monotonic);
+    pthread_cond_init(&writeBehind.flushed, NULL);
+    writeBehind.head = NULL;
+    writeBehind.tail = &writeBehind.head;
+    writeBehind.statsLines = NULL;
+    writeBehind.statsLength = 0;
+    writeBehind.count = 0;
+    writeBehind.queued = writeBehind.written = 0;
+    writeBehind.stopping = writeBehind.urgent = false;
+    if (pthread_create(&writeBehind.thread, NULL, runWriteBehind, NULL) != 0)
+    {
+        pthread_cond_destroy(&writeBehind.wake);
+        pthread_cond_destroy(&writeBehind.flushed);
+        return false;
+    }
+    writeBehind.running = true;
+    return true;
+}
+
+/**
+ * @brief Waits until every write queued so far is on disk (returns at once if write-behind is off).
+ * Afterwards the journal and the stats file may be rewritten: the thread stays idle until the next write.
+ */
+void drainPersistence()
+{
+    if (!writeBehind.running)
+        return;
+    handOffSearchCounts();
+    pthread_mutex_lock(&writeBehind.lock);
+    uint64_t target = writeBehind.queued;
+    if (writeBehind.written < target)
+    {
+        writeBehind.urgent = true;
+        pthread_cond_signal(&writeBehind.wake);
+        while (writeBehind.written < target)
+            pthread_cond_wait(&writeBehind.flushed, &writeBehind.lock);
+    }
+    pthread_mutex_unlock(&writeBehind.lock);
+}
+
+/**
+ * @brief Writes out everything still queued and stops the write-behind thread; later writes are synchronous again.
+ */
+void stopPersistence()
+{
+    if (!writeBehind.running)
+        return;
+    handOffSearchCounts();
+    pthread_mutex_lock(&writeBehind.lock);
+    writeBehind.stopping = true;
+    pthread_cond_signal(&writeBehind.wake);
+    pthread_mutex_unlock(&writeBehind.lock);
+    pthread_join(writeBehind.thread, NULL);
+    pthread_cond_destroy(&writeBehind.wake);
+    pthread_cond_destroy(&writeBehind.flushed);
+    writeBehind.running = false;
+}
+
+/**
+ * @brief Tells how many batches the write-behind thread failed to write, so callers can report
+ * failures that happened after the add, delete or search that queued them had already returned.
+ * @return The number of failed batches since the program started.
+ */
+long persistenceFailures()
+{
+    pthread_mutex_lock(&writeBehind.lock);
+    long failures = writeBehind.failures;
+    pthread_mutex_unlock(&writeBehind.lock);
+    return failures;
+}
+
+/**
+ * @brief Appends one mutation record ("+word" or "-word") to the journal.
+ * With write-behind running the record is only queued; if the thread later fails to write it,
+ * persistenceFailures() says so. Otherwise it reaches the OS immediately and fsync is batched
+ * every JOURNAL_SYNC_BATCH records.
+ * @param op '+' for an added word, '-' for a deleted word.
+ * @param word The word that changed.
+ * @return true if the record was queued or written, false if it could not be written.
+ */
+static bool appendJournal(char op, const char *word)
+{
+    METRIC_START(start);
+    if (queueWrite(op, word))
+    {
+        journalRecords++;
+        METRIC_STOP(METRIC_JOURNAL_WRITE, start);
+        return true;
+    }
+    if (!openJournal() || fprintf(journal, "%c%s\n", op, word) < 0 || fflush(journal) != 0)
+        return false;
+    journalRecords++;
+    bool ok = ++journalUnsynced < JOURNAL_SYNC_BATCH || syncJournal();
+    METRIC_STOP(METRIC_JOURNAL_WRITE, start);
+    return ok;
+}
+
+// --- SETTINGS ---
+
+/**
+ * @brief Selects the engine that queries and updates go to.
+ * The radix engine gets an empty radix tree the first time it is selected.
+ * @param engine The engine.
+ */
+void setEngine(Engine engine)
+{
+    activeEngine = engine;
+    if (engine == ENGINE_RADIX && !radixRoot)
+        radixRoot = createRadixNode("", 0); // The radix root has an empty edge label
+}
+
+/**
+ * @brief Returns the engine queries and updates go to.
+ * @return The engine (the Trie once leaveSnapshotEngine() has run).
+ */
+Engine getEngine()
+{
+    return activeEngine;
+}
+
+/**
+ * @brief Selects how searches are counted.
+ * @param mode STATS_EXACT or STATS_SKETCH.
+ */
+void setStatsMode(StatsMode mode)
+{
+    statsMode = mode;
+}
+
+/**
+ * @brief Returns how searches are counted.
+ * @return STATS_EXACT or STATS_SKETCH.
+ */
+StatsMode getStatsMode()
+{
+    return statsMode;
+}
+
+/**
+ * @brief Sets the time after which a sketched search counts half.
+ * @param seconds The half-life in seconds.
+ */
+void setSketchHalfLife(double seconds)
+{
+    sketchHalfLife = seconds;
+}
+
+/**
+ * @brief Sets the number of threads loadDictionary uses.
+ * @param threads The thread count (1 = load on the calling thread), clamped to 1..MAX_LOAD_THREADS.
+ */
+void setLoadThreads(int threads)
+{
+    loadThreads = threads < 1 ? 1 : threads > MAX_LOAD_THREADS ? MAX_LOAD_THREADS : threads;
+}
+
+/**
+ * @brief Returns the number of threads loadDictionary uses.
+ * @return The thread count.
+ */
+int getLoadThreads()
+{
+    return loadThreads;
+}
+
+/**
+ * @brief Requests a text scanner for loading the dictionary (a narrower one is used if the CPU lacks it).
+ * @param scanner The scanner, or SCAN_AUTO for the widest one available.
+ */
+void setTextScanner(TextScanner scanner)
+{
+    textScanner = scanner;
+}
+
+/**
+ * @brief Chooses whether loadDictionary builds the substring index (otherwise the first substring query does).
+ * @param enabled true to build it while loading.
+ */
+void setSubstringIndexing(bool enabled)
+{
+    substringIndexing = enabled;
+}
+
+/**
+ * @brief Sets the memory the prefix result cache may hold.
+ * @param bytes The budget in bytes (0 turns the cache off).
+ */
+void setPrefixCacheLimit(size_t bytes)
+{
+    prefixCacheLimit = bytes;
+}
+
+/**
+ * @brief Returns the number of records in the journal since the last compaction.
+ * @return The record count.
+ */
+int getJournalRecords()
+{
+    return journalRecords;
+}
+
+/**
+ * @brief Returns the heap allocations made so far by the word stores and statistics.
+ * @return The allocation count.
+ */
+unsigned long long getAllocationCount()
+{
+    return __atomic_load_n(&allocationCount, __ATOMIC_RELAXED);
+}
+
+// --- ENGINE SELECTION ---
+
+/**
+ * @brief Drops the double array after an update changed the Trie it was compiled from.
+ * Queries use the Trie until readyDoubleArray() recompiles it.
+ */
+static void dropDoubleArray()
+{
+    closeDoubleArray();
+    doubleArray.droppedUpdates++;
+    doubleArray.lastUpdate = nowNanoseconds();
+}
+
+/**
+ * @brief Tells a query whether the double-array engine can answer it, recompiling a dropped
+ * double array first once the updates have settled or enough of them have piled up.
+ * @param root The root node of the Trie.
+ * @return true if the query should use the double array, false if it should use the Trie.
+ */
+static bool readyDoubleArray(TrieNode *root)
+{
+    if (activeEngine != ENGINE_DOUBLE_ARRAY)
+        return false;
+    if (doubleArray.cells)
+        return true;
+    uint64_t now = nowNanoseconds();
+    if (doubleArray.droppedUpdates < DA_REBUILD_UPDATES && now - doubleArray.lastUpdate < DA_REBUILD_IDLE_MS * 1000000ULL)
+        return false; // Still being updated: a rebuild now would soon be dropped again
+    // A build that runs out of memory is retried after the next quiet period
+    doubleArray.droppedUpdates = 0;
+    doubleArray.lastUpdate = now;
+    return buildDoubleArray(root);
+}
+
+/**
+ * @brief Inserts a word using whichever engine was selected at startup.
+ * @param root The root node of the Trie (ignored by the radix engine).
+ * @param word The word to insert.
+ */
+void insertWord(TrieNode *root, const char *word)
+{
+    METRIC_START(start);
+    // Only a new word raises the count of its length; then the substring index and the prefix cache must know
+    int len = utf8Length(word);
+    uint32_t before = len < MAX_WORD_LEN ? activeLengths->counts[len] : 0;
+    if (activeEngine == ENGINE_RADIX)
+        radixInsert(radixRoot, word);
+    else
+        insert(root, word);
+    if (len && len < MAX_WORD_LEN && activeLengths->counts[len] > before)
+    {
+        if (activeEngine == ENGINE_DOUBLE_ARRAY)
+            dropDoubleArray(); // Out of date now
+        if (substringIndex.built)
+            addIndexedWord(word);
+        invalidatePrefixCache(word);
+    }
+    METRIC_STOP(METRIC_INSERT, start);
+}
+
+/**
+ * @brief Checks whether a complete word exists in the selected engine.
+ * @param root The root node of the Trie (ignored by the radix engine).
+ * @param word The word to search for.
+ * @return true if the word exists, false otherwise.
+ */
+bool containsWord(TrieNode *root, const char *word)
+{
+    if (activeEngine == ENGINE_RADIX)
+        return radixSearchWord(radixRoot, word);
+    if (activeEngine == ENGINE_SNAPSHOT)
+        return snapSearchWord(word);
+    if (readyDoubleArray(root))
+        return daSearchWord(word);
+    return searchWord(root, word);
+}
+
+/**
+ * @brief Checks whether any word starts with a prefix in the selected engine.
+ * @param root The root node of the Trie (ignored by the other engines).
+ * @param prefix The prefix to search for.
+ * @return true if the prefix exists, false otherwise.
+ */
+bool containsPrefix(TrieNode *root, const char *prefix)
+{
+    char buffer[MAX_WORD_LEN];
+    int depth;
+    if (activeEngine == ENGINE_RADIX)
+        return radixSearchPrefix(radixRoot, prefix, buffer, &depth) != NULL;
+    if (activeEngine == ENGINE_SNAPSHOT)
+        return snapSearchPrefix(prefix) != 0;
+    if (readyDoubleArray(root))
+        return daSearchPrefix(prefix) != DA_NONE;
+    return searchPrefix(root, prefix) != NULL;
+}
+
+/**
+ * @brief Passes every word that starts with a prefix to a sink, in alphabetical order, using the selected engine.
+ * Nothing is allocated; each word is only valid during its sink call.
+ * @param root The root node of the Trie (ignored by the other engines).
+ * @param prefix The prefix to complete ("" for every word).
+ * @param sink Called with every completion.
+ * @param context Passed to the sink unchanged.
+ * @return true if the prefix exists, false otherwise.
+ */
+bool emitCompletions(TrieNode *root, const char *prefix, WordSink sink, void *context)
+{
+    char buffer[MAX_WORD_LEN];
+
+    if (activeEngine == ENGINE_RADIX)
+    {
+        // The radix search fills the buffer with the path, which may run past the prefix
+        int depth;
+        RadixNode *node = radixSearchPrefix(radixRoot, prefix, buffer, &depth);
+        if (!node)
+            return false;
+        radixCollectWords(node, buffer, depth, sink, context);
+        return true;
+    }
+
+    strcpy(buffer, prefix); // Start the buffer with the prefix
+    if (activeEngine == ENGINE_SNAPSHOT)
+    {
+        uint32_t offset = snapSearchPrefix(prefix);
+        if (!offset)
+            return false;
+        snapCollectWords(offset, buffer, strlen(prefix), sink, context);
+        return true;
+    }
+    if (readyDoubleArray(root))
+    {
+        uint32_t node = daSearchPrefix(prefix);
+        if (node == DA_NONE)
+            return false;
+        daCollectWords(node, buffer, strlen(prefix), sink, context);
+        return true;
+    }
+
+    // Walk the words that start from the prefix node with an explicit stack instead of recursion
+    CompletionCursor cursor;
+    if (!cursorOpen(&cursor, root, prefix, NULL))
+        return false;
+    const char *word;
+    while ((word = cursorNext(&cursor)))
+    {
+        METRIC_COUNT(queryWords);
+        sink(word, context);
+    }
+    return true;
+}
+
+/**
+ * @brief Removes a word from the selected engine.
+ * @param root The root node of the Trie (ignored by the radix engine).
+ * @param word The word to remove.
+ */
+void removeWord(TrieNode *root, const char *word)
+{
+    METRIC_START(start);
+    int len = utf8Length(word);
+    uint32_t before = len < MAX_WORD_LEN ? activeLengths->counts[len] : 0;
+    if (activeEngine == ENGINE_RADIX)
+        radixRemove(radixRoot, word);
+    else
+        removeFromTrie(root, word);
+    if (len && len < MAX_WORD_LEN && activeLengths->counts[len] < before)
+    {
+        // The word was there and is gone
+        if (activeEngine == ENGINE_DOUBLE_ARRAY)
+            dropDoubleArray(); // Out of date now
+        if (substringIndex.built)
+            unindexWord(word);
+        invalidatePrefixCache(word);
+    }
+    METRIC_STOP(METRIC_DELETE, start);
+}
+
+/**
+ * @brief Updates the frequency count for a searched word/prefix.
+ * @param word The word whose search frequency needs to be updated.
+ * @return The new search count of the word (decayed and estimated in STATS_SKETCH mode).
+ */
+int updateFrequency(const char *word)
+{
+    if (statsMode == STATS_SKETCH)
+        return sketchAddSearch(word);
+    // A single hash lookup finds (or creates) the word's entry and counts the search as unsaved;
+    // the write-behind thread is handed the unsaved searches once per batch of words or interval
+    int frequency = addSearchCount(word, 1);
+    if (searchStats.unsavedCount >= PERSIST_BATCH ||
+        (searchStats.unsavedCount && nowNanoseconds() - searchStats.unsavedSince >= PERSIST_INTERVAL_MS * 1000000ULL))
+        handOffSearchCounts();
+    return frequency;
+}
+
+/**
+ * @brief Re-ranks a word after its search count changed, updating the caches on its path.
+ * @param root The root node of the Trie.
+ * @param word The word whose count changed (nothing happens if it is not in the Trie).
+ * @param frequency The new search count of the word.
+ */
+void updateWordRank(TrieNode *root, const char *word, int frequency)
+{
+    TrieNode *end = searchPrefix(root, word);
+    if (!end || !end->isEndOfWord)
+        return;
+    double weight = getSearchWeight(word, frequency);
+    bool dropped = weight < end->info->weight;
+    end->info->frequency = frequency;
+    end->info->weight = weight;
+
+    // Exact counts and scaled weights only ever go up, so offering the word again is enough to fix every cache
+    TrieNode *path[MAX_WORD_LEN + 1];
+    int depth = 0;
+    TrieNode *node = root;
+    path[depth++] = node;
+    offerTopWord(node, end->info);
+    for (const char *p = word; *p; p++)
+    {
+        node = getChild(node, *p);
+        path[depth++] = node;
+        offerTopWord(node, end->info);
+    }
+    // A weight that drops can let another word into a cache: rebuild them from the bottom up
+    if (dropped)
+        while (depth > 0)
+            recomputeTopWords(path[--depth]);
+}
+
+/**
+ * @brief Returns the best-ranked completions of a prefix from the cached top-K lists.
+ * Runs in O(prefix length + k), regardless of how many words start with the prefix.
+ * @param root The root node of the Trie.
+ * @param prefix The prefix to complete.
+ * @param results Array that receives up to k word records, best first.
+ * @param k The number of completions wanted (at most TOP_K are cached).
+ * @return The number of completions written to results, or -1 if the prefix is not found.
+ */
+int topKSuggestions(TrieNode *root, const char *prefix, WordInfo **results, int k)
+{
+    TrieNode *node = searchPrefix(root, prefix);
+    if (!node)
+        return -1;
+    if (k > node->topCount)
+        k = node->topCount;
+    memcpy(results, node->topWords, k * sizeof(WordInfo *));
+    if (statsMode == STATS_SKETCH && searchSketch.landmark)
+    {
+        double weight = sketchWeight(sketchClock());
+        for (int i = 0; i < k; i++)
+            decayFrequency(results[i], weight);
+    }
+    return k;
+}
+
+// --- SUBSTRING SEARCH ---
+
+/**
+ * @brief Builds the trigram index of every word in the selected engine, by walking all of them.
+ * loadDictionary() indexes the words as it inserts them instead, except after a parallel load.
+ * @param root The root node of the Trie (ignored by the other engines).
+ */
+void buildSubstringIndex(TrieNode *root)
+{
+    freeSubstringIndex();
+    substringIndex.deferPostings = true;
+    emitCompletions(root, "", indexWordSink, NULL);
+    postPendingWords();
+    substringIndex.built = true;
+}
+
+/**
+ * @brief qsort comparator for word pointers, in strcmp order.
+ */
+static int compareWordPointers(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Passes every word containing a fragment to a sink, in alphabetical order.
+ * Only the words holding the fragment's rarest trigram (or, for a shorter fragment, its byte pair
+ * or byte) are checked, so the work grows with the matches rather than with the dictionary. Only the
+ * empty fragment, which every word contains, checks every word.
+ * @param root The root node of the Trie (ignored by the other engines; used to build the index if needed).
+ * @param fragment The fragment (case-folded like any other query).
+ * @param sink Called with every matching word.
+ * @param context Passed to the sink unchanged.
+ * @return The number of matching words, or -1 if memory ran out.
+ */
+long emitSubstringMatches(TrieNode *root, const char *fragment, WordSink sink, void *context)
+{
+    METRIC_QUERY_BEGIN();
+    if (!substringIndex.built)
+        buildSubstringIndex(root);
+    size_t len = strlen(fragment);
+    const uint32_t *ids = NULL;
+    uint32_t count = 0;
+    if (len)
+    {
+        PostingList *list = rarestPostingList(fragment, len);
+        if (list)
+        {
+            ids = list->ids;
+            count = list->count;
+        }
+    }
+    else
+        count = substringIndex.wordCount; // Every id, deleted ones included
+
+    char **matches = (char **)malloc((count ? count : 1) * sizeof(char *));
+    if (!matches)
+    {
+        METRIC_QUERY_END();
+        return -1;
+    }
+    long found = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        char *word = substringIndex.words[ids ? ids[i] : i];
+        METRIC_COUNT(queryNodes);
+        if (word && strstr(word, fragment))
+            matches[found++] = word;
+    }
+    qsort(matches, found, sizeof(char *), compareWordPointers);
+    for (long i = 0; i < found; i++)
+    {
+        METRIC_COUNT(queryWords);
+        sink(matches[i], context);
+    }
+    free(matches);
+    METRIC_QUERY_END();
+    return found;
+}
+
+// --- CACHED COMPLETION ---
+
+/**
+ * @brief Word sink that passes each completion on and copies it into the list being materialized.
+ * Copying stops for good once the list outgrows the largest entry the cache admits.
+ * @param word The completion.
+ * @param context The CacheFill.
+ */
+static void fillCacheSink(const char *word, void *context)
+{
+    CacheFill *fill = (CacheFill *)context;
+    fill->sink(word, fill->context);
+    if (fill->overflow)
+        return;
+    size_t len = strlen(word) + 1;
+    if (fill->size + len > fill->capacity)
+    {
+        size_t capacity = fill->capacity ? fill->capacity * 2 : 256;
+        while (capacity < fill->size + len)
+            capacity *= 2;
+        char *words = capacity <= prefixCacheLimit / PREFIX_CACHE_ENTRY_SHARE ? (char *)realloc(fill->words, capacity) : NULL;
+        if (!words)
+        {
+            fill->overflow = true; // Too big to cache (or out of memory): answer without keeping it
+            return;
+        }
+        fill->words = words;
+        fill->capacity = capacity;
+    }
+    memcpy(fill->words + fill->size, word, len);
+    fill->size += len;
+    fill->count++;
+}
+
+/**
+ * @brief Stores a materialized completion list, evicting the least recently used entries to make room.
+ * @param prefix The prefix.
+ * @param hash hashWord(prefix).
+ * @param fill The list (its buffer is taken over by the cache).
+ */
+static void storePrefixEntry(const char *prefix, uint64_t hash, CacheFill *fill)
+{
+    size_t prefixLen = strlen(prefix);
+    PrefixCacheEntry *entry = (PrefixCacheEntry *)malloc(sizeof(PrefixCacheEntry) + prefixLen + 1);
+    if (!entry)
+    {
+        free(fill->words);
+        return;
+    }
+    entry->hash = hash;
+    entry->words = fill->words;
+    entry->size = fill->size;
+    entry->count = fill->count;
+    entry->bytes = sizeof(PrefixCacheEntry) + prefixLen + 1 + fill->capacity;
+    memcpy(entry->prefix, prefix, prefixLen + 1);
+
+    while (prefixCache.oldest &&
+           (prefixCache.entries >= PREFIX_CACHE_ENTRIES || prefixCache.bytes + entry->bytes > prefixCacheLimit))
+    {
+        dropPrefixEntry(prefixCache.oldest);
+        prefixCache.evictions++;
+    }
+    PrefixCacheEntry **bucket = &prefixCache.buckets[hash & (PREFIX_CACHE_BUCKETS - 1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    linkNewest(entry);
+    prefixCache.entries++;
+    prefixCache.bytes += entry->bytes;
+}
+
+/**
+ * @brief Passes every word that starts with a prefix to a sink, in alphabetical order, like
+ * emitCompletions(), but answers repeated prefixes from the prefix result cache.
+ * A hit replays the materialized list without touching the word store. A miss walks the store once,
+ * answering and materializing at the same time; lists larger than 1/PREFIX_CACHE_ENTRY_SHARE of
+ * the cache are answered without being kept.
+ * @param root The root node of the Trie (ignored by the other engines).
+ * @param prefix The prefix to complete.
+ * @param sink Called with every completion.
+ * @param context Passed to the sink unchanged.
+ * @return true if the prefix exists, false otherwise.
+ */
+bool emitCachedCompletions(TrieNode *root, const char *prefix, WordSink sink, void *context)
+{
+    if (!prefixCacheLimit)
+        return emitCompletions(root, prefix, sink, context);
+    uint64_t hash = hashWord(prefix);
+    PrefixCacheEntry *entry = findPrefixEntry(prefix, strlen(prefix), hash);
+    if (entry)
+    {
+        prefixCache.hits++;
+        unlinkRecency(entry);
+        linkNewest(entry);
+        for (const char *word = entry->words; word < entry->words + entry->size; word += strlen(word) + 1)
+        {
+            METRIC_COUNT(queryWords);
+            sink(word, context);
+        }
+        return true;
+    }
+
+    prefixCache.misses++;
+    CacheFill fill = {sink, context, NULL, 0, 0, 0, false};
+    bool found = emitCompletions(root, prefix, fillCacheSink, &fill);
+    if (found && !fill.overflow)
+        storePrefixEntry(prefix, hash, &fill);
+    else
+        free(fill.words);
+    return found;
+}
+
+/**
+ * @brief Materializes the completion lists of the most searched prefixes, so they are hits from the start.
+ * The prefixes come from the search statistics (loadSearchStats() must have run); the most searched
+ * one is cached last, which makes it the last to be evicted.
+ * @param root The root node of the Trie (ignored by the other engines).
+ * @param n The number of prefixes to warm.
+ * @return The number of prefixes that are cached afterwards.
+ */
+int prewarmPrefixCache(TrieNode *root, int n)
+{
+    WordFrequency **top = (WordFrequency **)malloc((n > 0 ? n : 1) * sizeof(WordFrequency *));
+    if (!top || !prefixCacheLimit)
+    {
+        free(top);
+        return 0;
+    }
+    long long ignored = 0;
+    int warmed = 0;
+    for (int i = topSearches(top, n) - 1; i >= 0; i--)
+    {
+        emitCachedCompletions(root, top[i]->word, countWord, &ignored);
+        warmed += findPrefixEntry(top[i]->word, strlen(top[i]->word), hashWord(top[i]->word)) != NULL;
+    }
+    prefixCache.hits = prefixCache.misses = 0; // Count only the queries that follow
+    free(top);
+    return warmed;
+}
+
+/**
+ * @brief Reports how well the prefix result cache did so far.
+ * @param hits Receives the queries answered from the cache.
+ * @param misses Receives the queries that walked the word store.
+ * @param invalidations Receives the entries dropped because a word below their prefix changed.
+ * @param evictions Receives the entries dropped to make room.
+ * @return The number of entries cached now.
+ */
+int prefixCacheStats(long *hits, long *misses, long *invalidations, long *evictions)
+{
+    *hits = prefixCache.hits;
+    *misses = prefixCache.misses;
+    *invalidations = prefixCache.invalidations;
+    *evictions = prefixCache.evictions;
+    return prefixCache.entries;
+}
+
+// --- WORD LENGTH INDEX ---
+
+/**
+ * @brief Returns the length index of the selected engine.
+ * The Trie and radix tree keep theirs up to date on every change; the snapshot stores its own in the header.
+ * @return The number of words of every length.
+ */
+static const LengthIndex *currentLengths()
+{
+    if (activeEngine == ENGINE_SNAPSHOT)
+        return &((const SnapHeader *)snapshot.base)->lengths;
+    return &wordLengths;
+}
+
+/**
+ * @brief Returns the length of the shortest word(s), without walking the words.
+ * @return The length in characters, or 0 if there are no words.
+ */
+int shortestWordLength()
+{
+    const LengthIndex *lengths = currentLengths();
+    for (int n = 1; n < MAX_WORD_LEN; n++)
+        if (lengths->counts[n])
+            return n;
+    return 0;
+}
+
+/**
+ * @brief Returns the length of the longest word(s), without walking the words.
+ * @return The length in characters, or 0 if there are no words.
+ */
+int longestWordLength()
+{
+    const LengthIndex *lengths = currentLengths();
+    for (int n = MAX_WORD_LEN - 1; n > 0; n--)
+        if (lengths->counts[n])
+            return n;
+    return 0;
+}
+
+/**
+ * @brief Returns how many words have a given length.
+ * @param length The length in characters.
+ * @return The number of words of that length.
+ */
+long wordsOfLength(int length)
+{
+    if (length <= 0 || length >= MAX_WORD_LEN)
+        return 0;
+    return currentLengths()->counts[length];
+}
+
+/**
+ * @brief Hands a word found by a length walk to its sink if it has the wanted length.
+ * @param walk The walk, whose buffer holds the word.
+ * @param depth The length of the word in bytes.
+ */
+static void offerWordOfLength(LengthWalk *walk, int depth)
+{
+    walk->buffer[depth] = '\0';
+    if (utf8Length(walk->buffer) != walk->length)
+        return;
+    METRIC_COUNT(queryWords);
+    walk->sink(walk->buffer, walk->context);
+    walk->remaining--;
+}
+
+/**
+ * @brief Recursively passes the words of the walk's length below a Trie node to its sink.
+ * Paths longer than the length are never entered, and the walk stops once every such word was found.
+ * @param walk The walk.
+ * @param node The current node.
+ * @param depth The length of the path in bytes.
+ * @param chars The number of UTF-8 lead bytes on the path (never more than its length in characters).
+ */
+static void trieWordsOfLength(LengthWalk *walk, TrieNode *node, int depth, int chars)
+{
+    METRIC_COUNT(queryNodes);
+    if (LOAD_ACQUIRE(node->isEndOfWord))
+        offerWordOfLength(walk, depth);
+    TrieNode *child;
+    for (int byte = -1; walk->remaining > 0 && (child = nextChild(node, &byte));)
+    {
+        int next = chars + ((byte & 0xC0) != 0x80); // Continuation bytes do not start a character
+        if (next > walk->length)
+            continue;
+        walk->buffer[depth] = byte;
+        trieWordsOfLength(walk, child, depth + 1, next);
+    }
+}
+
+/**
+ * @brief Recursively passes the words of the walk's length below a radix node to its sink.
+ * Takes the same arguments as trieWordsOfLength(), but walks a RadixNode.
+ */
+static void radixWordsOfLength(LengthWalk *walk, RadixNode *node, int depth, int chars)
+{
+    METRIC_COUNT(queryNodes);
+    if (node->isEndOfWord)
+        offerWordOfLength(walk, depth);
+    for (int i = 0; walk->remaining > 0 && i < node->childCount; i++)
+    {
+        RadixNode *child = node->children[i];
+        int next = chars;
+        for (int j = 0; j < child->labelLen; j++)
+            next += ((unsigned char)child->label[j] & 0xC0) != 0x80;
+        if (next > walk->length)
+            continue;
+        memcpy(walk->buffer + depth, child->label, child->labelLen);
+        radixWordsOfLength(walk, child, depth + child->labelLen, next);
+    }
+}
+
+/**
+ * @brief Recursively passes the words of the walk's length below a snapshot node to its sink.
+ * Takes the same arguments as trieWordsOfLength(), but walks snapshot offsets.
+ */
+static void snapWordsOfLength(LengthWalk *walk, uint32_t offset, int depth, int chars)
+{
+    METRIC_COUNT(queryNodes);
+    const SnapNode *node = snapNodeAt(offset);
+    if (node->isEndOfWord)
+        offerWordOfLength(walk, depth);
+    const unsigned char *labels = snapLabels(node);
+    const uint32_t *children = snapChildOffsets(node);
+    for (int i = 0; walk->remaining > 0 && i < node->childCount; i++)
+    {
+        int next = chars + ((labels[i] & 0xC0) != 0x80);
+        if (next > walk->length)
+            continue;
+        walk->buffer[depth] = labels[i];
+        snapWordsOfLength(walk, children[i], depth + 1, next);
+    }
+}
+
+/**
+ * @brief Passes every word of a given length to a sink, in alphabetical order, using the selected engine.
+ * The words are produced one at a time, with no limit on how many there are; the walk skips every
+ * longer path and ends as soon as the length index says all of them were found.
+ * @param root The root node of the Trie (ignored by the other engines).
+ * @param length The length in characters (see shortestWordLength and longestWordLength).
+ * @param sink Called with every word of that length.
+ * @param context Passed to the sink unchanged.
+ * @return true if there is at least one word of that length, false otherwise.
+ */
+bool emitWordsOfLength(TrieNode *root, int length, WordSink sink, void *context)
+{
+    LengthWalk walk = {length, wordsOfLength(length), sink, context, {0}};
+    if (walk.remaining == 0)
+        return false;
+    if (activeEngine == ENGINE_RADIX)
+        radixWordsOfLength(&walk, radixRoot, 0, 0);
+    else if (activeEngine == ENGINE_SNAPSHOT)
+        snapWordsOfLength(&walk, snapshot.rootOffset, 0, 0);
+    else
+        trieWordsOfLength(&walk, root, 0, 0);
+    return true;
+}
+
+// --- FUZZY SEARCH ---
+
+/**
+ * @brief Compares two fuzzy matches: closer first, then by the usual ranking.
+ * @param a The first match.
+ * @param b The second match.
+ * @return true if a should be listed before b.
+ */
+static bool fuzzyRanksHigher(const FuzzyMatch *a, const FuzzyMatch *b)
+{
+    if (a->distance != b->distance)
+        return a->distance < b->distance;
+    return ranksHigher(a->info, b->info);
+}
+
+/**
+ * @brief Offers a word to the result list of a fuzzy search, keeping the list sorted best first.
+ * @param search The fuzzy search in progress.
+ * @param info The word record to offer.
+ * @param distance The edit distance between the query and the closest prefix of the word.
+ */
+static void offerFuzzyMatch(FuzzySearch *search, WordInfo *info, int distance)
+{
+    FuzzyMatch match = {info, distance};
+    int pos = search->count;
+    while (pos > 0 && fuzzyRanksHigher(&match, &search->matches[pos - 1]))
+        pos--;
+    if (pos == TOP_K)
+        return; // The list is full and the word ranks below all of it
+    int count = search->count == TOP_K ? TOP_K - 1 : search->count; // The last entry may fall off
+    memmove(&search->matches[pos + 1], &search->matches[pos], (count - pos) * sizeof(FuzzyMatch));
+    search->matches[pos] = match;
+    search->count = count + 1;
+}
+
+/**
+ * @brief Visits a Trie node during a fuzzy search, extending the edit-distance table by one row per character.
+ * row[j] is the edit distance between the first j characters of the query and the path to this node, so
+ * row[queryLen] says how close the path itself is and the smallest entry bounds every word below it.
+ * Distances are counted in characters: the bytes of a multi-byte UTF-8 character are walked through
+ * first (pending > 0) and the row is only extended once the whole character is known.
+ * @param search The fuzzy search in progress.
+ * @param node The node being visited.
+ * @param row The edit-distance row for the path to this node (up to its last complete character).
+ * @param best The smallest row[queryLen] seen on the path (the distance of words ending below).
+ * @param partial The bits decoded so far of an unfinished UTF-8 character.
+ * @param pending The number of bytes that character still needs (0 on a character boundary).
+ */
+static void fuzzyVisit(FuzzySearch *search, TrieNode *node, const int *row, int best, uint32_t partial, int pending)
+{
+    int m = search->queryLen;
+    if (!pending)
+    {
+        int rowMin = row[0];
+        for (int j = 1; j <= m; j++)
+            if (row[j] < rowMin)
+                rowMin = row[j];
+
+        // Row minimums never decrease further down, so no word below can be closer than this
+        int bound = rowMin < best ? rowMin : best;
+        if (bound > search->maxDistance)
+            return;
+        if (search->count == TOP_K && bound > search->matches[TOP_K - 1].distance)
+            return; // Everything below would rank behind a full result list
+
+        if (rowMin >= best)
+        {
+            // Every word below is exactly best away, so the subtree's cached top words are its best matches
+            for (int i = 0; i < node->topCount; i++)
+                offerFuzzyMatch(search, node->topWords[i], best);
+            return;
+        }
+        if (node->isEndOfWord && best <= search->maxDistance)
+            offerFuzzyMatch(search, node->info, best);
+    }
+
+    int next[MAX_WORD_LEN + 1];
+    TrieNode *child;
+    for (int byte = -1; (child = nextChild(node, &byte));)
+    {
+        // Accumulate the bytes of a multi-byte character before comparing it
+        uint32_t codePoint;
+        int more;
+        if (pending)
+        {
+            codePoint = partial << 6 | (byte & 0x3F);
+            more = pending - 1;
+        }
+        else
+        {
+            more = utf8SequenceLength(byte) - 1;
+            // A lead byte contributes its payload bits; a single-byte character is its own code point
+            codePoint = more ? (uint32_t)(byte & (0x7F >> (more + 1))) : (uint32_t)byte;
+        }
+        if (more)
+        {
+            fuzzyVisit(search, child, row, best, codePoint, more);
+            continue;
+        }
+
+        // Standard Levenshtein recurrence: deletion, insertion or (mis)match
+        next[0] = row[0] + 1;
+        for (int j = 1; j <= m; j++)
+        {
+            int cost = search->query[j - 1] == codePoint ? 0 : 1;
+            int value = row[j - 1] + cost;
+            if (row[j] + 1 < value)
+                value = row[j] + 1;
+            if (next[j - 1] + 1 < value)
+                value = next[j - 1] + 1;
+            next[j] = value;
+        }
+        fuzzyVisit(search, child, next, next[m] < best ? next[m] : best, 0, 0);
+    }
+}
+
+/**
+ * @brief Finds the best completions of a prefix that may contain typos.
+ * A word matches if one of its prefixes is within maxDistance edits (insertions, deletions or
+ * substitutions) of the query. Branches that cannot get close enough are pruned, so only a small
+ * part of the Trie is visited for small distances.
+ * @param root The root node of the Trie.
+ * @param prefix The (possibly misspelled) prefix.
+ * @param maxDistance The largest edit distance accepted.
+ * @param results Array that receives up to TOP_K matches, closest first, then most searched.
+ * @return The number of matches written to results.
+ */
+int fuzzySuggestions(TrieNode *root, const char *prefix, int maxDistance, FuzzyMatch *results)
+{
+    FuzzySearch search;
+    search.queryLen = 0;
+    search.maxDistance = maxDistance;
+    search.count = 0;
+    if (strlen(prefix) >= MAX_WORD_LEN)
+        return 0;
+    // Compare whole characters, so a mistyped accented letter counts as one edit
+    for (const unsigned char *p = (const unsigned char *)prefix; *p;)
+        p += decodeUtf8(p, &search.query[search.queryLen++]);
+
+    // The empty path is j edits away from the first j letters of the query
+    int row[MAX_WORD_LEN + 1];
+    for (int j = 0; j <= search.queryLen; j++)
+        row[j] = j;
+    fuzzyVisit(&search, root, row, search.queryLen, 0, 0);
+
+    memcpy(results, search.matches, search.count * sizeof(FuzzyMatch));
+    if (statsMode == STATS_SKETCH && searchSketch.landmark)
+    {
+        double weight = sketchWeight(sketchClock());
+        for (int i = 0; i < search.count; i++)
+            decayFrequency(results[i].info, weight);
+    }
+    return search.count;
+}
+
+// --- DICTIONARY TEXT SCANNING ---
+
+/**
+ * @brief Finishes the line that ends at a given offset and hands it to the scan's handler.
+ * The line break, and the CR of a CRLF ending, become '\0'. Empty lines and lines that do not
+ * fit the word buffers are skipped.
+ * @param scan The scan.
+ * @param end Offset of the line break (or of the end of the text).
+ */
+static void endScannedLine(LineScan *scan, size_t end)
+{
+    char *line = scan->text + scan->lineStart;
+    size_t len = end - scan->lineStart;
+    scan->text[end] = '\0';
+    if (len && line[len - 1] == '\r')
+        line[--len] = '\0';
+    if (len && len < MAX_WORD_LEN)
+        scan->handler(line, !scan->nonAscii, scan->context);
+    scan->lineStart = end + 1;
+    scan->nonAscii = false;
+}
+
+/**
+ * @brief Finishes the lines whose breaks were found in one vector block.
+ * @param scan The scan.
+ * @param base Offset of the block.
+ * @param newlines Bit i is set if byte i of the block is '\n'.
+ * @param high Bit i is set if byte i of the block is not ASCII.
+ */
+static void endScannedLines(LineScan *scan, size_t base, uint32_t newlines, uint32_t high)
+{
+    while (newlines)
+    {
+        int bit = __builtin_ctz(newlines);
+        if (high & ((1u << bit) - 1))
+            scan->nonAscii = true; // A non-ASCII byte before the break belongs to this line
+        high &= ~0u << bit;
+        endScannedLine(scan, base + bit);
+        newlines &= newlines - 1;
+    }
+    if (high)
+        scan->nonAscii = true; // Carried into the line that continues in the next block
+}
+
+/**
+ * @brief Scans text one byte at a time: lowercases ASCII letters and ends lines at every '\n'.
+ * Used on its own when no vector unit is available, and for the tail the vector scanners leave.
+ * @param scan The scan.
+ * @param pos Offset to start at.
+ * @param end Offset to stop at.
+ */
+static void scanScalar(LineScan *scan, size_t pos, size_t end)
+{
+    unsigned char *text = (unsigned char *)scan->text;
+    for (; pos < end; pos++)
+    {
+        unsigned char c = text[pos];
+        if (c == '\n')
+            endScannedLine(scan, pos);
+        else if (c >= 'A' && c <= 'Z')
+            text[pos] = c + ('a' - 'A');
+        else if (c >= 0x80)
+            scan->nonAscii = true;
+    }
+}
+
+#if HAVE_X86_SIMD
+/**
+ * @brief Scans text 16 bytes at a time with SSE2.
+ * Each block is lowercased with one compare-and-or (bytes >= 0x80 compare as negative, so they are
+ * never taken for letters), and its line breaks and non-ASCII bytes come out as bit masks.
+ * @param scan The scan.
+ * @param pos Offset to start at.
+ * @param end Offset to stop at.
+ * @return Offset of the first byte not scanned (fewer than 16 bytes before end).
+ */
+static __attribute__((target("sse2"))) size_t scanSse2(LineScan *scan, size_t pos, size_t end)
+{
+    const __m128i newline = _mm_set1_epi8('\n'), beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1), caseBit = _mm_set1_epi8('a' - 'A');
+    for (; pos + 16 <= end; pos += 16)
+    {
+        __m128i *block = (__m128i *)(scan->text + pos);
+        __m128i bytes = _mm_loadu_si128(block);
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, beforeA), _mm_cmplt_epi8(bytes, afterZ));
+        if (_mm_movemask_epi8(upper))
+            _mm_storeu_si128(block, _mm_or_si128(bytes, _mm_and_si128(upper, caseBit)));
+        endScannedLines(scan, pos, _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)), _mm_movemask_epi8(bytes));
+    }
+    return pos;
+}
+
+/**
+ * @brief Scans text 32 bytes at a time with AVX2; otherwise the same as scanSse2().
+ */
+static __attribute__((target("avx2"))) size_t scanAvx2(LineScan *scan, size_t pos, size_t end)
+{
+    const __m256i newline = _mm256_set1_epi8('\n'), beforeA = _mm256_set1_epi8('A' - 1);
+    const __m256i afterZ = _mm256_set1_epi8('Z' + 1), caseBit = _mm256_set1_epi8('a' - 'A');
+    for (; pos + 32 <= end; pos += 32)
+    {
+        __m256i *block = (__m256i *)(scan->text + pos);
+        __m256i bytes = _mm256_loadu_si256(block);
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, beforeA), _mm256_cmpgt_epi8(afterZ, bytes));
+        if (_mm256_movemask_epi8(upper))
+            _mm256_storeu_si256(block, _mm256_or_si256(bytes, _mm256_and_si256(upper, caseBit)));
+        endScannedLines(scan, pos, (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)),
+                        (uint32_t)_mm256_movemask_epi8(bytes));
+    }
+    return pos;
+}
+#endif
+
+/**
+ * @brief Picks the text scanner to use: the one requested in textScanner, or the closest narrower
+ * one if the CPU lacks it.
+ * @return SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2.
+ */
+static TextScanner resolveTextScanner()
+{
+#if HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if ((textScanner == SCAN_AUTO || textScanner == SCAN_AVX2) && __builtin_cpu_supports("avx2"))
+        return SCAN_AVX2;
+    if (textScanner != SCAN_SCALAR && __builtin_cpu_supports("sse2"))
+        return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+/**
+ * @brief Returns the name of the text scanner the dictionary is loaded with.
+ * @return "scalar", "sse2" or "avx2".
+ */
+const char *textScannerName()
+{
+    return textScannerNames[resolveTextScanner()];
+}
+
+/**
+ * @brief Splits part of a text buffer into lines in place and hands each one to a handler.
+ * ASCII letters are lowercased on the way; lines with other bytes are flagged, so only they need
+ * foldCase(). The text must be writable up to and including text[end].
+ * @param text The text.
+ * @param start Offset of the first line.
+ * @param end Offset just past the last line.
+ * @param handler Called with every line that can be loaded, in order.
+ * @param context Passed to the handler unchanged.
+ */
+static void scanLines(char *text, size_t start, size_t end, LineHandler handler, void *context)
+{
+    LineScan scan = {text, start, false, handler, context};
+    size_t pos = start;
+#if HAVE_X86_SIMD
+    TextScanner scanner = resolveTextScanner();
+    if (scanner == SCAN_AVX2)
+        pos = scanAvx2(&scan, pos, end);
+    else if (scanner == SCAN_SSE2)
+        pos = scanSse2(&scan, pos, end);
+#endif
+    scanScalar(&scan, pos, end); // The bytes left over after the last whole vector
+    if (scan.lineStart < end)
+        endScannedLine(&scan, end); // The last line has no line break
+}
+
+// --- PARALLEL DICTIONARY LOADING ---
+
+/**
+ * @brief Appends a line offset to a line list, growing it as needed.
+ * @param list The list to append to.
+ * @param offset Offset of the line's first byte in the loaded text.
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool addLine(LineList *list, size_t offset)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        size_t *grown = (size_t *)realloc(list->offsets, capacity * sizeof(size_t));
+        if (!grown)
+            return false;
+        list->offsets = grown;
+        list->capacity = capacity;
+    }
+    list->offsets[list->count++] = offset;
+    return true;
+}
+
+/**
+ * @brief Line handler of phase 1: case-folds a line and buckets it by its first byte.
+ * @param line The line.
+ * @param ascii Whether the line is plain ASCII (then the scanner has folded it already).
+ * @param context The worker's LoadWorker.
+ */
+static void bucketLine(char *line, bool ascii, void *context)
+{
+    LoadWorker *worker = (LoadWorker *)context;
+    if (!ascii)
+        foldCase(line); // Folding can change the first byte, so do it before bucketing
+    addLine(&worker->buckets[(unsigned char)line[0]], line - worker->load->text);
+}
+
+/**
+ * @brief Phase 1 worker: splits its share of the text into lines, case-folds them and buckets them by first byte.
+ * Line breaks are replaced with '\0' in place, so every line becomes a C string.
+ * @param arg The worker's LoadWorker.
+ * @return NULL.
+ */
+static void *splitLinesWorker(void *arg)
+{
+    LoadWorker *worker = (LoadWorker *)arg;
+    scanLines(worker->load->text, worker->start, worker->end, bucketLine, worker);
+    return NULL;
+}
+
+/**
+ * @brief Phase 2 worker: builds whole root-child subtrees, one first byte at a time.
+ * First bytes are handed out largest first through a shared counter. Every node comes from the
+ * worker's own pool and each subtree is built by one worker only, so workers never touch the same memory.
+ * @param arg The worker's LoadWorker.
+ * @return NULL.
+ */
+static void *buildSubtreesWorker(void *arg)
+{
+    LoadWorker *worker = (LoadWorker *)arg;
+    ParallelLoad *load = worker->load;
+    activePool = &worker->pool; // createNode() now allocates from this worker's pool
+    activeLengths = &worker->lengths; // and insertAt() counts word lengths privately
+
+    int next;
+    while ((next = __atomic_fetch_add(&load->nextSubtree, 1, __ATOMIC_RELAXED)) < load->subtreeCount)
+    {
+        int first = load->order[next];
+        TrieNode *subtree = getChild(load->root, first);
+        if (!subtree)
+            subtree = createNode();
+        if (!subtree)
+            continue;
+        // Insert the lines of this byte from every phase 1 share, in file order
+        for (int w = 0; w < load->workerCount; w++)
+        {
+            LineList *lines = &load->workers[w].buckets[first];
+            for (size_t i = 0; i < lines->count; i++)
+                insertAt(subtree, load->text + lines->offsets[i], 1); // The subtree node stands for the first byte
+        }
+        load->subtrees[first] = subtree; // Attached by the main thread, since the root child array is shared
+    }
+    activePool = &nodePool;
+    activeLengths = &wordLengths;
+    return NULL;
+}
+
+/**
+ * @brief Reads a whole file into memory using large fread calls.
+ * @param file The open file.
+ * @param size Receives the number of bytes read.
+ * @return A malloc'd, null-terminated buffer, or NULL on failure.
+ */
+static char *readWholeFile(FILE *file, size_t *size)
+{
+    size_t capacity = LOAD_CHUNK_SIZE, used = 0;
+    char *text = (char *)malloc(capacity + 1);
+    if (!text)
+        return NULL;
+    size_t got;
+    while ((got = fread(text + used, 1, capacity - used, file)) > 0)
+    {
+        used += got;
+        if (used == capacity)
+        {
+            // Buffer full: double it and keep reading
+            char *grown = (char *)realloc(text, capacity * 2 + 1);
+            if (!grown)
+            {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+            capacity *= 2;
+        }
+    }
+    text[used] = '\0';
+    *size = used;
+    return text;
+}
+
+/**
+ * @brief Runs one phase of the parallel load on every worker and waits for all of them.
+ * A worker whose thread cannot be created does its share on the calling thread instead, so no
+ * part of the dictionary is skipped; only the threads that were created are joined.
+ * @param load The load in progress.
+ * @param ids Thread handles, one per worker.
+ * @param phase The phase's worker function.
+ */
+static void runLoadPhase(ParallelLoad *load, pthread_t *ids, void *(*phase)(void *))
+{
+    for (int w = 0; w < load->workerCount; w++)
+    {
+        LoadWorker *worker = &load->workers[w];
+        worker->threaded = pthread_create(&ids[w], NULL, phase, worker) == 0;
+        if (!worker->threaded)
+            phase(worker);
+    }
+    for (int w = 0; w < load->workerCount; w++)
+        if (load->workers[w].threaded)
+            pthread_join(ids[w], NULL);
+}
+
+/**
+ * @brief Loads the dictionary file into the Trie with several threads.
+ * The text is split into lines in parallel, then each first byte's subtree is built by one worker
+ * and attached under the root, so the subtrees are built independently.
+ * @param root The root node of the Trie.
+ * @param file The open dictionary file.
+ * @param threads The number of worker threads.
+ * @return true on success, false if the parallel load could not be set up (nothing was loaded).
+ */
+static bool loadDictionaryParallel(TrieNode *root, FILE *file, int threads)
+{
+    ParallelLoad load;
+    memset(&load, 0, sizeof(load));
+    load.root = root;
+    size_t size;
+    load.text = readWholeFile(file, &size);
+    load.workers = (LoadWorker *)calloc(threads, sizeof(LoadWorker));
+    pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (!load.text || !load.workers || !ids)
+    {
+        free(load.text);
+        free(load.workers);
+        free(ids);
+        return false;
+    }
+    load.workerCount = threads;
+
+    // Phase 1: give each worker an equal share of the text, with boundaries moved to line starts
+    size_t start = 0;
+    for (int w = 0; w < threads; w++)
+    {
+        size_t end = w == threads - 1 ? size : size / threads * (w + 1);
+        if (end < start)
+            end = start;
+        while (end > start && end < size && load.text[end - 1] != '\n')
+            end++;
+        load.workers[w] = (LoadWorker){&load, start, end, {{0}}, {NULL, NULL}, {{0}}, false};
+        start = end;
+    }
+    runLoadPhase(&load, ids, splitLinesWorker);
+
+    // Order the first bytes by amount of work, largest first, so the big subtrees start early
+    size_t work[BYTE_VALUES] = {0};
+    for (int c = 0; c < BYTE_VALUES; c++)
+    {
+        for (int w = 0; w < threads; w++)
+            work[c] += load.workers[w].buckets[c].count;
+        load.order[c] = c;
+    }
+    for (int i = 1; i < BYTE_VALUES; i++)
+    {
+        int c = load.order[i], j = i;
+        while (j > 0 && work[load.order[j - 1]] < work[c])
+        {
+            load.order[j] = load.order[j - 1];
+            j--;
+        }
+        load.order[j] = c;
+    }
+
+    // First bytes without lines are skipped entirely
+    load.subtreeCount = BYTE_VALUES;
+    while (load.subtreeCount > 0 && work[load.order[load.subtreeCount - 1]] == 0)
+        load.subtreeCount--;
+
+    // Phase 2: build the subtrees in parallel
+    runLoadPhase(&load, ids, buildSubtreesWorker);
+
+    // Attach the finished subtrees and hand the workers' slabs over to the global pool
+    for (int c = 0; c < BYTE_VALUES; c++)
+        if (load.subtrees[c])
+            setChild(root, c, load.subtrees[c]);
+    for (int w = 0; w < threads; w++)
+    {
+        mergePool(&nodePool, &load.workers[w].pool);
+        for (int n = 0; n < MAX_WORD_LEN; n++)
+            wordLengths.counts[n] += load.workers[w].lengths.counts[n];
+        for (int c = 0; c < BYTE_VALUES; c++)
+            free(load.workers[w].buckets[c].offsets);
+    }
+    // The root's cache and word count were not touched by the workers, so rebuild them from the subtrees
+    recomputeTopWords(root);
+    TrieNode *child;
+    root->wordCount = root->isEndOfWord;
+    for (int byte = -1; (child = nextChild(root, &byte));)
+        root->wordCount += child->wordCount;
+
+    free(load.text);
+    free(load.workers);
+    free(ids);
+    return true;
+}
+
+// --- FILE I/O AND UTILITY FUNCTIONS ---
+
+/**
+ * @brief Replays the mutation journal on top of the words loaded from the dictionary file.
+ * A torn last record (no trailing newline, e.g. after a crash) is ignored.
+ * @param root The root node of the Trie.
+ * @return The number of records replayed.
+ */
+static int replayJournal(TrieNode *root)
+{
+    FILE *file = fopen(JOURNAL_FILE, "r");
+    if (!file)
+        return 0; // No journal yet: nothing has changed since the last compaction
+
+    char line[MAX_WORD_LEN + 2]; // Room for the operation byte and the newline
+    int records = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        size_t len = strcspn(line, "\r\n");
+        if (!line[len])
+        {
+            // A torn last record, or an overlong one: skip the rest of it so its tail is not read as a record
+            int c;
+            while ((c = fgetc(file)) != '\n' && c != EOF)
+                ;
+            continue;
+        }
+        line[len] = '\0';
+        char *word = line + 1;
+        foldCase(word);
+        if (line[0] == '+' && *word)
+            insertWord(root, word);
+        else if (line[0] == '-' && *word)
+            removeWord(root, word);
+        records++;
+    }
+    fclose(file);
+    return records;
+}
+
+/**
+ * @brief Line handler of the single-threaded load: case-folds a line and inserts it into the selected engine.
+ * @param line The line.
+ * @param ascii Whether the line is plain ASCII (then the scanner has folded it already).
+ * @param context The root node of the Trie.
+ */
+static void insertLine(char *line, bool ascii, void *context)
+{
+    if (!ascii)
+        foldCase(line);
+    insertWord((TrieNode *)context, line);
+}
+
+/**
+ * @brief Loads words from the dictionary file into the Trie.
+ * @param root The root node of the Trie.
+ * @return false if the dictionary file does not exist (the Trie is then left empty).
+ */
+bool loadDictionary(TrieNode *root)
+{
+    FILE *file = fopen(DICTIONARY_FILE, "r"); // Open the file in read mode
+    if (!file)
+        return false;
+    METRIC_START(start);
+
+    // From here on insertWord adds every new word to the substring index (posted after the file is in)
+    clearPrefixCache();
+    freeSubstringIndex();
+    substringIndex.built = substringIndexing;
+    substringIndex.deferPostings = true;
+
+    // The Trie can be built by several threads at once; the other engines load on this thread
+    bool trieEngine = activeEngine == ENGINE_TRIE || activeEngine == ENGINE_DOUBLE_ARRAY;
+    if (trieEngine && loadThreads > 1 && loadDictionaryParallel(root, file, loadThreads))
+    {
+        if (substringIndexing)
+            buildSubstringIndex(root); // The loader threads insert without going through insertWord
+    }
+    else
+    {
+        // Read the whole file at once and split it with the text scanner instead of one fgets call per line
+        rewind(file);
+        size_t size;
+        char *text = readWholeFile(file, &size);
+        if (text)
+            scanLines(text, 0, size, insertLine, root);
+        free(text);
+    }
+    fclose(file); // Close the file
+    postPendingWords(); // Before the journal, whose deletions look words up in the posting lists
+    // Apply the words added/deleted since the dictionary file was last compacted
+    journalRecords = replayJournal(root);
+    if (activeEngine == ENGINE_DOUBLE_ARRAY)
+        buildDoubleArray(root); // Compiled once the Trie holds every word
+    METRIC_STOP(METRIC_LOAD, start);
+    return true;
+}
+
+/**
+ * @brief Switches from the read-only snapshot engine to the Trie so the dictionary can be modified.
+ * The Trie is built from the text dictionary; the snapshot is rewritten from it at exit.
+ * @param root The (empty) root node of the Trie.
+ */
+void leaveSnapshotEngine(TrieNode *root)
+{
+    if (activeEngine != ENGINE_SNAPSHOT)
+        return;
+    closeSnapshot();
+    activeEngine = ENGINE_TRIE;
+    loadDictionary(root);
+}
+
+/**
+ * @brief Records a new word in the dictionary's append-only journal.
+ * @param word The word to save.
+ * @return true on success, false if the journal could not be opened.
+ */
+bool saveWordToFile(const char *word)
+{
+    return appendJournal('+', word);
+}
+
+/**
+ * @brief Records a deleted word in the dictionary's append-only journal.
+ * This costs one small append instead of rewriting the whole dictionary file.
+ * @param word The word to remove.
+ * @return true on success, false if the journal could not be opened.
+ */
+bool removeWordFromFile(const char *word)
+{
+    return appendJournal('-', word);
+}
+
+/**
+ * @brief Word sink that writes each word on its own line.
+ * @param word The word.
+ * @param context The FILE to write to.
+ */
+static void writeWordLine(const char *word, void *context)
+{
+    fputs(word, (FILE *)context);
+    putc('\n', (FILE *)context);
+}
+
+/**
+ * @brief Rewrites the dictionary file from the words currently loaded and empties the journal.
+ * The new file is written to a temporary name, synced and renamed over the old one, so a crash
+ * leaves either the old dictionary plus its journal or the new dictionary (replaying the journal
+ * on top of it is harmless).
+ * @param root The root node of the Trie (ignored by the other engines).
+ * @return true on success, false otherwise.
+ */
+bool compactDictionary(TrieNode *root)
+{
+    drainPersistence(); // Queued records must not land in the journal after it was emptied
+    METRIC_START(start);
+    FILE *temp = fopen(DICTIONARY_FILE ".tmp", "w");
+    if (!temp)
+        return false;
+
+    // Stream every word into the temporary file through a large stdio buffer
+    setvbuf(temp, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+    emitCompletions(root, "", writeWordLine, temp);
+
+    bool ok = fflush(temp) == 0 && fsync(fileno(temp)) == 0;
+    ok = fclose(temp) == 0 && ok;
+    if (!ok || rename(DICTIONARY_FILE ".tmp", DICTIONARY_FILE) != 0)
+    {
+        remove(DICTIONARY_FILE ".tmp");
+        METRIC_STOP(METRIC_COMPACT, start);
+        return false;
+    }
+
+    // Make the rename itself durable before dropping the journal
+    int dir = open(".", O_RDONLY);
+    if (dir >= 0)
+    {
+        fsync(dir);
+        close(dir);
+    }
+
+    // Everything in the journal is now part of the dictionary file
+    closeJournal();
+    FILE *file = fopen(JOURNAL_FILE, "w");
+    if (file)
+    {
+        fsync(fileno(file));
+        fclose(file);
+    }
+    journalRecords = 0;
+    // A settled dictionary is the point to recompile a double array that updates have dropped
+    if (activeEngine == ENGINE_DOUBLE_ARRAY && !doubleArray.cells)
+        buildDoubleArray(root);
+    METRIC_STOP(METRIC_COMPACT, start);
+    return true;
+}
+
+/**
+ * @brief Loads search statistics from the stats file (the sketch file in STATS_SKETCH mode) at the start of the program.
+ */
+void loadSearchStats()
+{
+    if (statsMode == STATS_SKETCH)
+    {
+        METRIC_START(start);
+        loadSearchSketch();
+        METRIC_STOP(METRIC_STATS_FILE, start);
+        return;
+    }
+    FILE *file = fopen(STATS_FILE, "r");
+    if (!file)
+        return; // If file doesn't exist, just return silently
+    METRIC_START(start);
+
+    char word[MAX_WORD_LEN];
+    int freq;
+
+    // Read word and frequency pairs from the file (repeated words are added together)
+    while (fscanf(file, "%99s %d", word, &freq) == 2)
+    {
+        addSearchCount(word, freq);
+    }
+
+    fclose(file);
+    METRIC_STOP(METRIC_STATS_FILE, start);
+}
+
+/**
+ * @brief Saves the current search statistics to the stats file (the sketch file in STATS_SKETCH mode) before exiting.
+ */
+void saveSearchStats()
+{
+    if (statsMode == STATS_SKETCH)
+    {
+        METRIC_START(start);
+        saveSearchSketch(); // Like the text file, a failed save keeps the previous state
+        METRIC_STOP(METRIC_STATS_FILE, start);
+        return;
+    }
+    // The totals written here include every queued delta, which must not be appended after them
+    drainPersistence();
+    FILE *file = fopen(STATS_FILE ".tmp", "w"); // Replaces the old stats (and appended deltas) once complete
+    if (!file)
+        return;
+    METRIC_START(start);
+
+    // Write each tracked word and its frequency to the file
+    for (size_t i = 0; i < searchStats.capacity; i++)
+    {
+        if (searchStats.slots[i].word)
+            fprintf(file, "%s %d\n", searchStats.slots[i].word, searchStats.slots[i].frequency);
+    }
+
+    // Renamed only once on disk, so a crash keeps either the old file or the new one
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(STATS_FILE ".tmp", STATS_FILE) != 0)
+        remove(STATS_FILE ".tmp");
+    METRIC_STOP(METRIC_STATS_FILE, start);
+}
+
+// --- METRICS DUMP ---
+
+/**
+ * @brief Appends the current metrics to the metrics file, after a "# <unix time>" line.
+ */
+void saveMetrics()
+{
+#if ENABLE_METRICS
+    FILE *file = fopen(METRICS_FILE, "a"); // Append, so dumps from earlier runs are kept
+    if (!file)
+        return;
+    fprintf(file, "# %lld\n", (long long)time(NULL));
+    char line[128];
+    for (int i = 0; metricLine(i, line, sizeof(line)); i++)
+        fprintf(file, "%s\n", line);
+    fclose(file);
+#endif
+}
@@ -0,0 +1,244 @@
+#ifndef AUTOSUGGEST_H
+#define AUTOSUGGEST_H
+
+// Auto-suggest library: the Trie, radix tree and snapshot word stores, ranked and fuzzy completion,
+// the dictionary files and the instrumentation. Queries never print; they hand their results to
+// a caller-supplied sink (WordSink) or write them into caller-provided buffers.
+
+#include <stdbool.h>  // For using the boolean data type (true, false)
+#include <stddef.h>   // For size_t
+#include <stdint.h>   // For fixed-width integer types
+
+// --- MACRO DEFINITIONS ---
+
+#define MAX_WORD_LEN 100       // Maximum length of a word that can be processed
+#define DICTIONARY_FILE "Dictionary.txt" // Filename for the dictionary
+#define STATS_FILE "SearchStats.txt" // Filename for storing search frequency statistics
+#define SKETCH_FILE "SearchStats.sketch" // Binary state of the streaming (sketched) search statistics
+#define SKETCH_HALF_LIFE (7 * 24 * 3600.0) // Default half-life of sketched search counts, in seconds
+#define JOURNAL_FILE "Dictionary.journal" // Append-only log of words added/deleted since the last compaction
+#define SNAPSHOT_FILE "Dictionary.snap" // Filename for the compiled binary Trie snapshot
+#define SERVER_SOCKET "autosuggest.sock" // Default Unix socket path of the query server (autosuggest --serve)
+#define JOURNAL_COMPACT_THRESHOLD 1000 // Journal records that trigger a compaction at startup or exit
+#define MAX_READERS 64         // Maximum number of lock-free reader threads in concurrency mode
+#define MAX_LOAD_THREADS 64    // Maximum number of threads loading the dictionary (setLoadThreads clamps to it)
+#define STRESS_SECONDS 3       // Default length of the concurrency stress run, in seconds
+#define TOP_K 8                // Number of best-ranked completions cached in every Trie node
+#define FUZZY_DISTANCE 1       // Default number of typos tolerated by fuzzy suggestions
+#define MAX_FUZZY_DISTANCE 3   // Largest number of typos a fuzzy search may be asked to tolerate
+#define PREFIX_CACHE_MB 32     // Default memory budget of the prefix result cache, in MiB
+#define PREFIX_CACHE_PREWARM 64 // Most searched prefixes whose completions are cached at startup when asked to
+
+// Compile-time switch for the hot-path instrumentation (build with -DENABLE_METRICS=0 to remove it).
+// The library and the programs using it must be built with the same setting.
+#ifndef ENABLE_METRICS
+#define ENABLE_METRICS 1
+#endif
+#define METRICS_FILE "Metrics.txt"   // Metrics dumps are appended here, in the layout of the stats file
+
+// --- DATA STRUCTURES ---
+
+// Receives each word produced by a query; the word is only valid during the call
+typedef void (*WordSink)(const char *word, void *context);
+
+// Record kept for every word stored in the Trie, used to rank completions
+typedef struct WordInfo
+{
+    double weight; // Ranking key: the search count, or its forward-decay scaled weight in STATS_SKETCH mode
+    int frequency; // How many times the word has been searched (decayed in STATS_SKETCH mode)
+    char word[];   // The word itself, allocated together with the record
+} WordInfo;
+
+// Node of the Trie; only the library looks inside it
+typedef struct TrieNode TrieNode;
+
+// A word found by a fuzzy search, with its edit distance from the query
+typedef struct
+{
+    WordInfo *info; // The matching word
+    int distance;   // Edits between the query and the closest prefix of the word
+} FuzzyMatch;
+
+// A paused depth-first walk over the completions of a prefix (see cursorNext)
+typedef struct
+{
+    TrieNode *nodes[MAX_WORD_LEN]; // The path from the prefix node down to the current node
+    int bytes[MAX_WORD_LEN];       // Edge byte last taken below each node on the path (-1 before the first)
+    int depth;                     // Number of nodes on the path (0 once every completion was returned)
+    int prefixLen;                 // Length of the prefix; nodes[i] ends at word length prefixLen + i
+    bool emitPending;              // Whether the word ending at the deepest node is still to be returned
+    char word[MAX_WORD_LEN];       // The word along the path; after cursorNext, the word it returned
+} CompletionCursor;
+
+// The word-storage engines that can be selected at startup
+typedef enum
+{
+    ENGINE_TRIE, // Classic Trie with bitmap-indexed child arrays (default)
+    ENGINE_RADIX,   // Path-compressed radix tree with byte-run edge labels
+    ENGINE_SNAPSHOT, // Read-only queries straight from the memory-mapped binary snapshot
+    ENGINE_DOUBLE_ARRAY // Queries from a double-array trie compiled from the Trie; updates go to the Trie
+} Engine;
+
+// Slot of the search statistics hash table, tracking how often a word/prefix was searched
+typedef struct
+{
+    char *word;    // The word/prefix that was searched (NULL marks an empty slot)
+    uint64_t hash; // Cached hash of the word, so growing the table does not rehash strings
+    int frequency; // How many times it has been searched
+    int unsaved;   // Searches not yet handed to the write-behind thread
+} WordFrequency;
+
+// How search statistics are kept
+typedef enum
+{
+    STATS_EXACT, // Exact lifetime count of every searched word/prefix, in STATS_FILE (default)
+    STATS_SKETCH // Time-decayed estimates in fixed memory (Count-Min Sketch + Space-Saving), in SKETCH_FILE
+} StatsMode;
+
+// Implementations of the text scanner that splits and case-folds the dictionary file while loading
+typedef enum
+{
+    SCAN_AUTO,   // The widest one the CPU supports
+    SCAN_SCALAR, // One byte at a time (always available)
+    SCAN_SSE2,   // 16 bytes at a time
+    SCAN_AVX2    // 32 bytes at a time
+} TextScanner;
+
+// Results of a concurrency stress run
+typedef struct
+{
+    int readers;      // Reader threads that ran
+    long long reads;  // Lookups and completions performed by all readers
+    double seconds;   // Length of the run
+    long writes;      // Insertions and deletions performed by the writer
+    long long errors; // Lookups that missed a word that was never deleted
+} StressReport;
+
+// --- INSTRUMENTATION ---
+
+uint64_t nowNanoseconds();
+uint64_t beginQuery();
+void endQuery(uint64_t start);
+#if ENABLE_METRICS
+bool metricLine(int index, char *line, size_t size);
+#endif
+void saveMetrics();
+
+// --- SETTINGS ---
+
+// Chosen on the command line, before the dictionary is loaded
+void setEngine(Engine engine);
+Engine getEngine();
+void setStatsMode(StatsMode mode);
+StatsMode getStatsMode();
+void setSketchHalfLife(double seconds);
+void setLoadThreads(int threads);
+int getLoadThreads();
+void setTextScanner(TextScanner scanner);
+void setSubstringIndexing(bool enabled);
+void setPrefixCacheLimit(size_t bytes);
+
+// Counters kept by the library
+int getJournalRecords();
+unsigned long long getAllocationCount();
+
+// --- WORD STORES ---
+
+// Trie nodes and the Trie itself (destroyTrie frees every node at once)
+TrieNode *createNode();
+void destroyTrie();
+void insert(TrieNode *root, const char *word);
+bool searchWord(TrieNode *root, const char *word);
+TrieNode *searchPrefix(TrieNode *root, const char *prefix);
+bool isEmpty(TrieNode *node);
+void collectWords(TrieNode *node, char *buffer, int depth, WordSink sink, void *context);
+void foldCase(char *str);
+
+// Radix tree engine (setEngine creates the tree)
+void closeRadixTree();
+
+// Binary snapshot engine
+bool writeSnapshot(TrieNode *root);
+bool isSnapshotFresh();
+bool openSnapshot();
+void closeSnapshot();
+void leaveSnapshotEngine(TrieNode *root);
+
+// Double-array engine (built by loadDictionary; after updates, rebuilt by the next query once they settle)
+bool buildDoubleArray(TrieNode *root);
+void closeDoubleArray();
+
+// --- QUERIES AND UPDATES (SELECTED ENGINE) ---
+
+void insertWord(TrieNode *root, const char *word);
+void removeWord(TrieNode *root, const char *word);
+bool containsWord(TrieNode *root, const char *word);
+bool containsPrefix(TrieNode *root, const char *prefix);
+bool emitCompletions(TrieNode *root, const char *prefix, WordSink sink, void *context);
+void countWord(const char *word, void *context);
+
+// Word lengths (in characters), kept up to date by every insertion and deletion
+int shortestWordLength();
+int longestWordLength();
+long wordsOfLength(int length);
+bool emitWordsOfLength(TrieNode *root, int length, WordSink sink, void *context);
+
+// Paged completion (Trie engine)
+bool cursorOpen(CompletionCursor *cursor, TrieNode *root, const char *prefix, const char *after);
+const char *cursorNext(CompletionCursor *cursor);
+int cursorNextBatch(CompletionCursor *cursor, char (*words)[MAX_WORD_LEN], int n);
+
+// Completion counts and random access by position (Trie engine)
+long countPrefix(TrieNode *root, const char *prefix);
+long rankWord(TrieNode *root, const char *word);
+bool selectWord(TrieNode *root, const char *prefix, long k, char *word);
+
+// Ranked and typo-tolerant completion (Trie engine)
+int updateFrequency(const char *word);
+void updateWordRank(TrieNode *root, const char *word, int frequency);
+int topKSuggestions(TrieNode *root, const char *prefix, WordInfo **results, int k);
+int fuzzySuggestions(TrieNode *root, const char *prefix, int maxDistance, FuzzyMatch *results);
+int topSearches(WordFrequency **results, int n);
+
+// Substring (infix) search over a trigram index, kept in sync by insertWord and removeWord
+void buildSubstringIndex(TrieNode *root);
+void freeSubstringIndex();
+long emitSubstringMatches(TrieNode *root, const char *fragment, WordSink sink, void *context);
+
+// Hot-prefix result cache in front of emitCompletions (an entry is dropped when a word below its prefix changes)
+bool emitCachedCompletions(TrieNode *root, const char *prefix, WordSink sink, void *context);
+int prewarmPrefixCache(TrieNode *root, int n);
+void clearPrefixCache();
+int prefixCacheStats(long *hits, long *misses, long *invalidations, long *evictions);
+
+// Lock-free readers against a writer (Trie engine): between beginConcurrentMode() and endConcurrentMode(),
+// reader threads wrap each query in readerEnter() and readerExit() while updates go through concurrentInsert()
+// and concurrentDelete()
+void beginConcurrentMode();
+void endConcurrentMode();
+int registerReader();
+void readerEnter(int slot);
+void readerExit(int slot);
+void concurrentInsert(TrieNode *root, const char *word);
+void concurrentDelete(TrieNode *root, const char *word);
+bool runConcurrencyStress(TrieNode *root, int readers, double seconds, StressReport *report);
+
+// --- FILES ---
+
+bool loadDictionary(TrieNode *root);
+const char *textScannerName();
+bool saveWordToFile(const char *word);
+bool removeWordFromFile(const char *word);
+bool compactDictionary(TrieNode *root);
+void closeJournal();
+void loadSearchStats();
+void saveSearchStats();
+void freeSearchStats();
+
+// Write-behind persistence: a background thread writes the journal records and exact search counts
+bool startPersistence();
+void drainPersistence();
+void stopPersistence();
+long persistenceFailures();
+
+#endif
@@ -0,0 +1,330 @@
+#define _POSIX_C_SOURCE 200809L // Expose POSIX functions such as clock_gettime under strict C modes
+
+// Client of the auto-suggest query server ("autosuggest --serve"). It either forwards batch
+// commands from stdin and prints the answers, or load-tests the server with several connections
+// that keep a number of pipelined requests in flight.
+
+#include <stdio.h>      // For printf, fgets and the error messages
+#include <stdlib.h>     // For malloc, qsort and atoi
+#include <string.h>     // For strlen, strcmp and memcpy
+#include <unistd.h>     // For read, write and close
+#include <pthread.h>    // For the stdin forwarder and the load-test connections
+#include <time.h>       // For clock_gettime() when timing requests
+#include <sys/socket.h> // For the connection to the server
+#include <sys/un.h>     // For Unix domain socket addresses
+
+#include "autosuggest.h" // For SERVER_SOCKET and MAX_WORD_LEN
+
+// --- MACRO DEFINITIONS ---
+
+#define CLIENT_BUFFER_SIZE 65536      // Bytes read from the server per call
+#define MAX_REQUEST_LINES 100000      // Request lines a load test cycles through
+#define DEFAULT_CONNECTIONS 4         // Load-test connections unless --connections is given
+#define DEFAULT_PIPELINE 16           // Requests in flight per connection unless --pipeline is given
+#define DEFAULT_REQUESTS 100000       // Requests sent in total unless --requests is given
+
+// --- DATA STRUCTURES ---
+
+// Work of one load-test connection
+typedef struct
+{
+    int fd;             // The connection to the server
+    long requests;      // Requests to send
+    long offset;        // Index of the first request line to send (spreads connections over the lines)
+    int pipeline;       // Requests kept in flight
+    uint64_t *latencies; // Nanoseconds from sending each request to the end of its answer
+    bool failed;        // The connection broke before every answer arrived
+} LoadTask;
+
+// --- GLOBAL STATE ---
+
+char *requestLines[MAX_REQUEST_LINES]; // The load-test requests, each ending with '\n'
+int requestCount = 0;                  // Number of entries in requestLines
+
+// --- CONNECTION FUNCTIONS ---
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ * @return Nanoseconds since an arbitrary fixed point.
+ */
+uint64_t clientNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Connects to the server's Unix domain socket.
+ * @param path The socket path.
+ * @return The connected socket, or -1 (with a message on stderr).
+ */
+int connectToServer(const char *path)
+{
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Writes a whole buffer to a socket, retrying short writes.
+ * @param fd The socket.
+ * @param data The bytes to write.
+ * @param len The number of bytes.
+ * @return true if everything was written.
+ */
+bool writeAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+        if (written <= 0)
+            return false;
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+// --- FORWARDING MODE ---
+
+/**
+ * @brief Copies stdin to the server, then tells it nothing more is coming.
+ * Runs on its own thread, so requests are pipelined while the answers are still being printed.
+ * @param arg Pointer to the connected socket.
+ * @return NULL.
+ */
+void *forwardRequests(void *arg)
+{
+    int fd = *(int *)arg;
+    char line[CLIENT_BUFFER_SIZE];
+    size_t len;
+    while ((len = fread(line, 1, sizeof(line), stdin)) > 0)
+        if (!writeAll(fd, line, len))
+            break;
+    shutdown(fd, SHUT_WR); // The server answers what it has, then closes the connection
+    return NULL;
+}
+
+/**
+ * @brief Sends the commands on stdin to the server and prints its answers on stdout.
+ * @param path The socket path.
+ * @return 0 on success, 1 if the server could not be reached.
+ */
+int forwardCommands(const char *path)
+{
+    int fd = connectToServer(path);
+    if (fd < 0)
+        return 1;
+    pthread_t sender;
+    if (pthread_create(&sender, NULL, forwardRequests, &fd) != 0)
+    {
+        close(fd);
+        return 1;
+    }
+    char buffer[CLIENT_BUFFER_SIZE];
+    ssize_t received;
+    while ((received = read(fd, buffer, sizeof(buffer))) > 0)
+        fwrite(buffer, 1, received, stdout);
+    pthread_join(sender, NULL);
+    close(fd);
+    fflush(stdout);
+    return 0;
+}
+
+// --- LOAD TEST MODE ---
+
+/**
+ * @brief Runs one load-test connection: keeps task->pipeline requests in flight until all are answered.
+ * An answer ends with a blank line, so the end of each one is found by counting empty lines.
+ * @param arg The LoadTask of the connection.
+ * @return NULL.
+ */
+void *runLoadConnection(void *arg)
+{
+    LoadTask *task = (LoadTask *)arg;
+    uint64_t *sentAt = (uint64_t *)malloc(task->pipeline * sizeof(uint64_t)); // Ring of send times
+    char buffer[CLIENT_BUFFER_SIZE];
+    long sent = 0, answered = 0;
+    bool lineStart = true; // Whether the next byte starts a line (a '\n' there ends an answer)
+    task->failed = !sentAt;
+    while (!task->failed && answered < task->requests)
+    {
+        // Top up the pipeline
+        while (sent < task->requests && sent - answered < task->pipeline)
+        {
+            const char *line = requestLines[(task->offset + sent) % requestCount];
+            sentAt[sent % task->pipeline] = clientNanoseconds();
+            if (!writeAll(task->fd, line, strlen(line)))
+            {
+                task->failed = true;
+                break;
+            }
+            sent++;
+        }
+        ssize_t received = task->failed ? 0 : read(task->fd, buffer, sizeof(buffer));
+        if (received <= 0)
+        {
+            task->failed = true;
+            break;
+        }
+        uint64_t now = clientNanoseconds();
+        for (ssize_t i = 0; i < received; i++)
+        {
+            if (buffer[i] == '\n' && lineStart)
+            {
+                task->latencies[answered] = now - sentAt[answered % task->pipeline];
+                answered++;
+            }
+            lineStart = buffer[i] == '\n';
+        }
+    }
+    free(sentAt);
+    return NULL;
+}
+
+/**
+ * @brief qsort comparator for uint64_t values, ascending.
+ */
+int compareLatencies(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Load-tests the server with the request lines read from stdin and prints throughput and latencies.
+ * Blank lines and lines starting with '#' are skipped, since the server does not answer them.
+ * @param path The socket path.
+ * @param connections Number of concurrent connections.
+ * @param pipeline Requests kept in flight per connection.
+ * @param requests Requests sent in total (split evenly over the connections).
+ * @return 0 if every request was answered, 1 otherwise.
+ */
+int runLoadTest(const char *path, int connections, int pipeline, long requests)
+{
+    char line[MAX_WORD_LEN + 16];
+    while (requestCount < MAX_REQUEST_LINES && fgets(line, sizeof(line), stdin))
+    {
+        size_t len = strcspn(line, "\r\n");
+        if (!line[len] && !feof(stdin))
+        {
+            // Too long to be a request: skip the rest of it
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF)
+                ;
+            continue;
+        }
+        if (len == 0 || line[0] == '#')
+            continue; // The server does not answer blank lines and comments
+        strcpy(line + len, "\n");
+        requestLines[requestCount] = strdup(line);
+        if (requestLines[requestCount])
+            requestCount++;
+    }
+    if (requestCount == 0)
+    {
+        fprintf(stderr, "No requests on stdin\n");
+        return 1;
+    }
+
+    LoadTask *tasks = (LoadTask *)calloc(connections, sizeof(LoadTask));
+    pthread_t *threads = (pthread_t *)malloc(connections * sizeof(pthread_t));
+    uint64_t *latencies = (uint64_t *)malloc(requests * sizeof(uint64_t));
+    int status = tasks && threads && latencies ? 0 : 1;
+    int started = 0;
+    uint64_t start = clientNanoseconds();
+    for (long first = 0; status == 0 && started < connections; started++)
+    {
+        LoadTask *task = &tasks[started];
+        task->requests = requests / connections + (started < requests % connections);
+        task->offset = first * 7919 % requestCount; // Different connections start at different lines
+        task->pipeline = pipeline;
+        task->latencies = latencies + first;
+        task->fd = connectToServer(path);
+        first += task->requests;
+        if (task->fd < 0 || pthread_create(&threads[started], NULL, runLoadConnection, task) != 0)
+        {
+            if (task->fd >= 0)
+                close(task->fd);
+            status = 1;
+            break;
+        }
+    }
+    long answered = 0;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+        close(tasks[i].fd);
+        if (tasks[i].failed)
+            status = 1;
+        else
+            memmove(latencies + answered, tasks[i].latencies, tasks[i].requests * sizeof(uint64_t));
+        answered += tasks[i].failed ? 0 : tasks[i].requests;
+    }
+    double seconds = (clientNanoseconds() - start) / 1e9;
+
+    if (answered > 0)
+    {
+        qsort(latencies, answered, sizeof(uint64_t), compareLatencies);
+        printf("connections=%d pipeline=%d requests=%ld seconds=%.3f requests_per_sec=%.0f "
+               "p50_us=%.1f p90_us=%.1f p99_us=%.1f max_us=%.1f\n",
+               started, pipeline, answered, seconds, answered / seconds, latencies[answered / 2] / 1e3,
+               latencies[answered * 9 / 10] / 1e3, latencies[answered * 99 / 100] / 1e3, latencies[answered - 1] / 1e3);
+    }
+    if (status)
+        fprintf(stderr, "Some connections failed before every request was answered\n");
+    for (int i = 0; i < requestCount; i++)
+        free(requestLines[i]);
+    free(tasks);
+    free(threads);
+    free(latencies);
+    return status;
+}
+
+// --- MAIN FUNCTION ---
+
+int main(int argc, char *argv[])
+{
+    const char *path = SERVER_SOCKET;
+    bool loadTest = false;
+    int connections = DEFAULT_CONNECTIONS;
+    int pipeline = DEFAULT_PIPELINE;
+    long requests = DEFAULT_REQUESTS;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--socket=", 9) == 0)
+            path = argv[i] + 9;
+        else if (strcmp(argv[i], "--load-test") == 0)
+            loadTest = true;
+        else if (strncmp(argv[i], "--connections=", 14) == 0)
+            connections = atoi(argv[i] + 14);
+        else if (strncmp(argv[i], "--pipeline=", 11) == 0)
+            pipeline = atoi(argv[i] + 11);
+        else if (strncmp(argv[i], "--requests=", 11) == 0)
+            requests = atol(argv[i] + 11);
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n"
+                            "Usage: %s [--socket=PATH] < COMMANDS\n"
+                            "       %s --load-test [--socket=PATH] [--connections=N] [--pipeline=N] [--requests=N] < COMMANDS\n",
+                    argv[i], argv[0], argv[0]);
+            return 1;
+        }
+    }
+    if (connections < 1 || pipeline < 1 || requests < connections)
+    {
+        fprintf(stderr, "--connections and --pipeline must be positive, and --requests at least --connections\n");
+        return 1;
+    }
+    return loadTest ? runLoadTest(path, connections, pipeline, requests) : forwardCommands(path);
+}
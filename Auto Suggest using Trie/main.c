@@ -1,15 +1,36 @@
+#define _POSIX_C_SOURCE 200809L // Expose POSIX functions such as clock_gettime under strict C modes
+
 #include <stdio.h>    // For standard input/output functions like printf, scanf
 #include <stdlib.h>   // For memory allocation functions like malloc, free, and exit
-#include <stdbool.h>  // For using the boolean data type (true, false)
 #include <string.h>   // For string manipulation functions like strcpy, strcmp, strlen
+#include <unistd.h>   // For getcwd()/chdir() around the benchmark scratch directory
+#include <errno.h>    // For EAGAIN/EINTR from the server's non-blocking sockets
+#include <fcntl.h>    // For fcntl() to make the server's sockets non-blocking
+#include <signal.h>   // For stopping the server cleanly on SIGINT/SIGTERM
+#include <sys/epoll.h> // For the server's event loop
+#include <sys/resource.h> // For getrusage() to report peak memory in benchmarks
+#include <sys/socket.h> // For the server's listening and client sockets
+#include <sys/un.h>   // For Unix domain socket addresses
+
+#include "autosuggest.h" // The Trie library this program is a front-end for
 
 // --- MACRO DEFINITIONS ---
 
-#define ALPHABET_SIZE 26       // The number of letters in the English alphabet
-#define MAX_WORD_LEN 100       // Maximum length of a word that can be processed
-#define DICTIONARY_FILE "Dictionary.txt" // Filename for the dictionary
 #define MAX_SESSION_WORDS 1000 // Maximum number of words that can be added/deleted in one session
-#define STATS_FILE "SearchStats.txt" // Filename for storing search frequency statistics
+#define TOP_SEARCHES 10        // Number of entries shown by "most frequently searched words"
+#define BATCH_BUFFER_SIZE 65536 // Size of the output buffer used in batch mode
+#define BATCH_LINE_SIZE (MAX_WORD_LEN + 16) // Longest batch command line, including its line break
+#define SERVER_INPUT_SIZE 65536 // Bytes of pipelined requests buffered per server connection
+#define SERVER_OUTPUT_LIMIT (1 << 20) // Unsent response bytes after which a connection's requests wait
+#define SERVER_MAX_EVENTS 64   // Socket events handled per epoll_wait call
+#define PAGE_SIZE 10           // Completions shown per page when browsing page by page
+#define BENCH_DEFAULT_MAX_WORDS 1000000 // Largest synthetic dictionary benchmarked by default
+#define BENCH_OPERATIONS 100000 // Timed operations per benchmark (fewer for small dictionaries)
+#define BENCH_COLLECT_OPERATIONS 1000 // Timed prefix enumerations per benchmark
+#define BENCH_HOT_PREFIXES 16  // Distinct prefixes the cached completion benchmark cycles through
+#define BENCH_WORD_LEN 32      // Buffer size for one synthetic word
+#define BENCH_LETTERS 26       // Synthetic words are made of the letters a-z
+#define BENCH_SEED 0x5EEDF00DULL // Fixed seed, so every build benchmarks the same dictionaries
 
 // ANSI color macros for styling the console output
 #define RED "\x1b[31m"
@@ -28,163 +49,180 @@
 
 // --- DATA STRUCTURES ---
 
-// Structure for a single node in the Trie data structure
-typedef struct TrieNode
+// Output formats supported by batch mode
+typedef enum
+{
+    FORMAT_TEXT, // One result per line, with a blank line after each query
+    FORMAT_TSV   // "query<TAB>result" rows
+} OutputFormat;
+
+// Growable buffer holding the responses a server connection has not sent yet
+typedef struct
+{
+    char *data;      // The responses; data[sent..used) is still to be sent
+    size_t used;     // Bytes in data
+    size_t sent;     // Bytes of data already written to the socket
+    size_t capacity; // Allocated size of data
+    bool failed;     // The buffer could not grow, so the connection has to be dropped
+} OutputBuffer;
+
+// One client connection of the server
+typedef struct Connection
 {
-    struct TrieNode *children[ALPHABET_SIZE]; // Array of pointers to child nodes, one for each letter
-    bool isEndOfWord;                         // Flag to mark if a node represents the end of a complete word
-} TrieNode;
+    int fd;                         // The connected socket
+    char input[SERVER_INPUT_SIZE];  // Received request bytes not answered yet
+    size_t inputUsed;               // Bytes in input
+    bool skipping;                  // Discarding the rest of an overlong request line
+    bool closing;                   // The client is done sending; close once everything is answered
+    OutputBuffer output;            // Responses waiting to be sent
+    struct Connection *prev, *next; // Open connections, so the server can close them when it stops
+} Connection;
 
-// Structure to track the frequency of searched words
+// Buffered writer used by batch mode, so results are written in large chunks
 typedef struct
 {
-    char word[MAX_WORD_LEN]; // The word/prefix that was searched
-    int frequency;           // How many times it has been searched
-} WordFrequency;
+    FILE *stream;                  // Where the buffered output goes
+    OutputBuffer *buffer;          // In server mode, where the output is appended instead (stream is unused)
+    char data[BATCH_BUFFER_SIZE];  // Bytes not written yet
+    size_t used;                   // Number of bytes in data
+    OutputFormat format;           // Plain text or TSV
+    const char *query;             // The query being answered (first TSV column)
+    int results;                   // Number of result lines written for that query
+} BatchWriter;
 
-// Global array to store word search frequencies for the current session
-WordFrequency wordFreqList[MAX_SESSION_WORDS];
-int wordFreqCount = 0; // Counter for the number of unique words tracked in wordFreqList
+// The batch writer in use, or NULL in interactive mode (results then go to the console in color)
+BatchWriter *batchOutput = NULL;
+bool batchMode = false; // Set by --batch and --serve; keeps status messages off stdout
+volatile sig_atomic_t serverStopping = 0; // Set by SIGINT/SIGTERM to end the server's event loop
+volatile uintptr_t benchSink; // Benchmarked lookups store their result here, so they cannot be optimized away
+long reportedWriteFailures = 0; // Failed background writes already reported on stderr
 
-// --- TRIE FUNCTIONS ---
+// --- OUTPUT FUNCTIONS ---
 
 /**
- * @brief Creates and initializes a new TrieNode.
- * @return A pointer to the newly allocated TrieNode, or NULL if allocation fails.
+ * @brief Appends bytes to a growable output buffer (doubling its size when full).
+ * @param buffer The buffer; on allocation failure it is marked failed and left unchanged.
+ * @param data The bytes to append.
+ * @param len The number of bytes.
  */
-TrieNode *createNode()
+void appendOutput(OutputBuffer *buffer, const char *data, size_t len)
 {
-    // Allocate memory for a new node
-    TrieNode *newNode = (TrieNode *)malloc(sizeof(TrieNode));
-    if (newNode)
+    if (buffer->failed)
+        return;
+    if (buffer->used + len > buffer->capacity)
     {
-        // Mark that this node is not the end of a word by default
-        newNode->isEndOfWord = false;
-        // Initialize all children pointers to NULL
-        for (int i = 0; i < ALPHABET_SIZE; i++)
-            newNode->children[i] = NULL;
+        size_t capacity = buffer->capacity ? buffer->capacity : BATCH_BUFFER_SIZE;
+        while (capacity < buffer->used + len)
+            capacity *= 2;
+        char *grown = (char *)realloc(buffer->data, capacity);
+        if (!grown)
+        {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
     }
-    return newNode;
+    memcpy(buffer->data + buffer->used, data, len);
+    buffer->used += len;
 }
 
 /**
- * @brief Converts a given string to lowercase.
- * @param str The string to be converted.
+ * @brief Writes everything buffered by the batch writer to its stream.
  */
-void toLowerCase(char *str)
+void batchFlush()
 {
-    // Iterate through the string until the null terminator is found
-    for (int i = 0; str[i]; i++)
-        // If the character is an uppercase letter, convert it to lowercase
-        if (str[i] >= 'A' && str[i] <= 'Z')
-            str[i] += ('a' - 'A'); // Add the offset between 'a' and 'A'
+    fwrite(batchOutput->data, 1, batchOutput->used, batchOutput->stream);
+    batchOutput->used = 0;
 }
 
 /**
- * @brief Inserts a word into the Trie.
- * @param root The root node of the Trie.
- * @param word The word to insert.
+ * @brief Appends bytes to the batch writer, flushing only when its buffer fills up.
+ * @param data The bytes to write.
+ * @param len The number of bytes.
  */
-void insert(TrieNode *root, const char *word)
+void batchWrite(const char *data, size_t len)
 {
-    TrieNode *node = root;
-    // Iterate through each character of the word
-    while (*word)
+    // A server connection has its own growable buffer, so there is nothing to flush
+    if (batchOutput->buffer)
+    {
+        appendOutput(batchOutput->buffer, data, len);
+        return;
+    }
+    if (batchOutput->used + len > BATCH_BUFFER_SIZE)
     {
-        // Calculate the index (0-25) for the character
-        int index = *word - 'a';
-        // If the character is not a valid lowercase letter, stop
-        if (index < 0 || index >= ALPHABET_SIZE)
+        batchFlush();
+        // Anything larger than the whole buffer goes straight to the stream
+        if (len > BATCH_BUFFER_SIZE)
+        {
+            fwrite(data, 1, len, batchOutput->stream);
             return;
-        // If the child node for this character doesn't exist, create it
-        if (!node->children[index])
-            node->children[index] = createNode();
-        // Move to the child node
-        node = node->children[index];
-        // Move to the next character in the word
-        word++;
+        }
     }
-    // After inserting all characters, mark the final node as the end of a word
-    node->isEndOfWord = true;
+    memcpy(batchOutput->data + batchOutput->used, data, len);
+    batchOutput->used += len;
 }
 
 /**
- * @brief Searches for a prefix in the Trie and returns the node where the prefix ends.
- * @param root The root node of the Trie.
- * @param prefix The prefix to search for.
- * @return The TrieNode at the end of the prefix, or NULL if the prefix is not found.
+ * @brief Writes one result line for the current batch query.
+ * In TSV format the line is "query<TAB>value"; in text format it is just the value.
+ * @param value The result to write.
  */
-TrieNode *searchPrefix(TrieNode *root, const char *prefix)
+void batchWriteResult(const char *value)
 {
-    TrieNode *node = root;
-    // Iterate through each character of the prefix
-    while (*prefix)
+    if (batchOutput->format == FORMAT_TSV)
     {
-        int index = *prefix - 'a';
-        // If the character is not a valid lowercase letter, the prefix doesn't exist
-        if (index < 0 || index >= ALPHABET_SIZE)
-            return NULL;
-        // If there's no path for this character, the prefix doesn't exist
-        if (!node->children[index])
-            return NULL;
-        // Move to the next node in the path
-        node = node->children[index];
-        prefix++;
+        batchWrite(batchOutput->query, strlen(batchOutput->query));
+        batchWrite("\t", 1);
     }
-    // Return the node where the prefix ends
-    return node;
+    batchWrite(value, strlen(value));
+    batchWrite("\n", 1);
+    batchOutput->results++;
 }
 
 /**
- * @brief Recursively collects and prints all words starting from a given Trie node.
- * This function performs a Depth-First Search (DFS).
- * @param node The starting node for collection.
- * @param buffer A character buffer to build the current word.
- * @param depth The current depth in the Trie (length of the word in the buffer).
+ * @brief Word sink that outputs one suggested word, either to the batch writer or as colored console text.
+ * @param word The word to output.
+ * @param context Unused.
  */
-void collectWords(TrieNode *node, char *buffer, int depth)
+void emitSuggestion(const char *word, void *context)
 {
-    // If the current node marks the end of a word, print the word
-    if (node->isEndOfWord)
-    {
-        buffer[depth] = '\0'; // Null-terminate the string
-        printf(CYAN " - %s\n" RESET, buffer);
-    }
-    // Recur for all children of the current node
-    for (int i = 0; i < ALPHABET_SIZE; i++)
-    {
-        if (node->children[i])
-        {
-            // Add the character to the buffer
-            buffer[depth] = i + 'a';
-            // Recursively call for the child node, increasing the depth
-            collectWords(node->children[i], buffer, depth + 1);
-        }
-    }
+    (void)context;
+    if (batchOutput)
+        batchWriteResult(word);
+    else
+        printf(CYAN " - %s\n" RESET, word);
 }
 
 /**
- * @brief Updates the frequency count for a searched word/prefix.
- * @param word The word whose search frequency needs to be updated.
+ * @brief Word sink that prints one word of a list, preceded by the list's header before the first one.
+ * @param word The word.
+ * @param context Pointer to the header still to be printed (set to NULL once it is).
  */
-void updateFrequency(const char *word)
+void printListedWord(const char *word, void *context)
 {
-    // Check if the word is already in our frequency list
-    for (int i = 0; i < wordFreqCount; i++)
-    {
-        if (strcmp(wordFreqList[i].word, word) == 0)
-        {
-            // If found, increment its frequency and return
-            wordFreqList[i].frequency++;
-            return;
-        }
-    }
-    // If the word is not in the list, add it as a new entry
-    strcpy(wordFreqList[wordFreqCount].word, word);
-    wordFreqList[wordFreqCount].frequency = 1;
-    wordFreqCount++; // Increment the count of unique searched words
+    const char **header = (const char **)context;
+    if (*header)
+        printf("%s", *header);
+    *header = NULL;
+    printf(CYAN " - %s\n" RESET, word);
 }
 
+/**
+ * @brief Reports on stderr the background writes that failed since the last report.
+ * Adds and deletes only queue their journal records, so a failure shows up after they returned.
+ */
+void reportWriteFailures()
+{
+    long failures = persistenceFailures();
+    if (failures > reportedWriteFailures)
+        fprintf(stderr, "Error: %ld background write(s) to the journal or stats file failed!\n",
+                failures - reportedWriteFailures);
+    reportedWriteFailures = failures;
+}
+
+// --- MENU FUNCTIONS ---
+
 /**
  * @brief Provides auto-suggestions for a given prefix.
  * @param root The root node of the Trie.
@@ -192,402 +230,1385 @@ void updateFrequency(const char *word)
  */
 void autoSuggest(TrieNode *root, const char *prefix)
 {
-    // Find the node where the prefix ends
-    TrieNode *node = searchPrefix(root, prefix);
-    if (!node)
+    uint64_t start = beginQuery();
+    // Repeated prefixes come from the prefix result cache; the header is printed with the first suggestion
+    const char *header = GREEN "Suggestions:\n" RESET;
+    if (!emitCachedCompletions(root, prefix, printListedWord, &header))
+    {
+        printf(BOLDRED "No suggestions found.\n" RESET);
+    }
+    else
+    {
+        // Track the search frequency for this prefix (and re-rank it if it is a word)
+        int frequency = updateFrequency(prefix);
+        if (getEngine() == ENGINE_TRIE || getEngine() == ENGINE_DOUBLE_ARRAY)
+            updateWordRank(root, prefix, frequency);
+    }
+    endQuery(start);
+}
+
+/**
+ * @brief Shows the highest-ranked completions of a prefix, most searched first.
+ * @param root The root node of the Trie.
+ * @param prefix The prefix to find suggestions for.
+ */
+void showTopSuggestions(TrieNode *root, const char *prefix)
+{
+    WordInfo *results[TOP_K];
+    int count = topKSuggestions(root, prefix, results, TOP_K);
+    if (count <= 0)
     {
         printf(BOLDRED "No suggestions found.\n" RESET);
         return;
     }
 
-    // Track the search frequency for this prefix
-    updateFrequency(prefix);
+    printf(GREEN "Top suggestions:\n" RESET);
+    for (int i = 0; i < count; i++)
+        printf(CYAN " - %s (%d searches)\n" RESET, results[i]->word, results[i]->frequency);
 
-    char buffer[MAX_WORD_LEN];
-    strcpy(buffer, prefix); // Start the buffer with the prefix
-    printf(GREEN "Suggestions:\n" RESET);
-    // Collect all words that start from the prefix node
-    collectWords(node, buffer, strlen(prefix));
+    // Count this as a search, like autoSuggest() does (after printing, since it may re-rank)
+    updateWordRank(root, prefix, updateFrequency(prefix));
 }
 
-// --- FILE I/O AND UTILITY FUNCTIONS ---
-
 /**
- * @brief Loads words from the dictionary file into the Trie.
+ * @brief Shows the completions of a prefix PAGE_SIZE at a time, asking before each further page.
+ * Only the part of the subtree that is shown gets visited.
  * @param root The root node of the Trie.
+ * @param prefix The prefix to complete.
  */
-void loadDictionary(TrieNode *root)
+void showCompletionPages(TrieNode *root, const char *prefix)
 {
-    FILE *file = fopen(DICTIONARY_FILE, "r"); // Open the file in read mode
-    if (!file)
+    CompletionCursor cursor;
+    if (!cursorOpen(&cursor, root, prefix, NULL))
     {
-        // If the file doesn't exist, show a warning but continue
-        printf(ORANGE "Warning: Dictionary file not found. Proceeding with an empty trie.\n" RESET);
+        printf(BOLDRED "No suggestions found.\n" RESET);
         return;
     }
 
-    char word[MAX_WORD_LEN];
-    // Read each line (word) from the file
-    while (fgets(word, MAX_WORD_LEN, file))
+    long pages = (countPrefix(root, prefix) + PAGE_SIZE - 1) / PAGE_SIZE;
+    char words[PAGE_SIZE][MAX_WORD_LEN];
+    for (int page = 1;; page++)
     {
-        // Remove trailing newline or carriage return characters
-        word[strcspn(word, "\r\n")] = 0;
-        toLowerCase(word); // Convert the word to lowercase
-        insert(root, word);  // Insert the word into the Trie
+        int count = cursorNextBatch(&cursor, words, PAGE_SIZE);
+        if (count == 0)
+        {
+            printf(YELLOW "No more suggestions.\n" RESET);
+            return;
+        }
+        printf(GREEN "Suggestions (page %d of %ld):\n" RESET, page, pages);
+        for (int i = 0; i < count; i++)
+            printf(CYAN " - %s\n" RESET, words[i]);
+        if (count < PAGE_SIZE)
+            return; // That was the last page
+
+        char more;
+        printf(ORANGE "Show the next page? (y/n): " RESET);
+        if (scanf(" %c", &more) != 1 || (more != 'y' && more != 'Y'))
+            return;
     }
-    fclose(file); // Close the file
-    printf(GREEN "Dictionary loaded successfully!\n" RESET);
 }
 
 /**
- * @brief Appends a new word to the dictionary file.
- * @param word The word to save.
+ * @brief Shows the closest completions of a prefix that may contain typos.
+ * @param root The root node of the Trie.
+ * @param prefix The (possibly misspelled) prefix.
+ * @param maxDistance The largest edit distance accepted.
  */
-void saveWordToFile(const char *word)
+void showFuzzySuggestions(TrieNode *root, const char *prefix, int maxDistance)
 {
-    FILE *file = fopen(DICTIONARY_FILE, "a"); // Open the file in append mode
-    if (!file)
+    FuzzyMatch results[TOP_K];
+    int count = fuzzySuggestions(root, prefix, maxDistance, results);
+    if (count == 0)
     {
-        printf(BOLDRED "Error opening dictionary file!\n" RESET);
+        printf(BOLDRED "No suggestions found.\n" RESET);
         return;
     }
-    fprintf(file, "%s\n", word); // Write the word followed by a newline
-    fclose(file);                // Close the file
+
+    printf(GREEN "Did you mean:\n" RESET);
+    for (int i = 0; i < count; i++)
+        printf(CYAN " - %s (%d edit%s, %d searches)\n" RESET, results[i].info->word, results[i].distance,
+               results[i].distance == 1 ? "" : "s", results[i].info->frequency);
 }
 
 /**
- * @brief Checks if a TrieNode has any children.
- * @param node The node to check.
- * @return true if the node has no children, false otherwise.
+ * @brief Shows every word containing a fragment, wherever it appears in the word.
+ * @param root The root of the Trie.
+ * @param fragment The fragment to look for.
  */
-bool isEmpty(TrieNode *node)
+void showSubstringMatches(TrieNode *root, const char *fragment)
 {
-    for (int i = 0; i < ALPHABET_SIZE; i++)
-        if (node->children[i])
-            return false; // Found a child, so it's not empty
-    return true;
+    const char *header = GREEN "Words containing it:\n" RESET;
+    long count = emitSubstringMatches(root, fragment, printListedWord, &header);
+    if (count < 0)
+        printf(BOLDRED "Not enough memory for the search.\n" RESET);
+    else if (count == 0)
+        printf(BOLDRED "No words contain it.\n" RESET);
 }
 
 /**
- * @brief A recursive helper function to delete a word from the Trie.
- * @param node The current node in the traversal.
- * @param word The remaining part of the word to delete.
- * @return true if the parent node should delete the reference to this node.
+ * @brief Deletes a word from the Trie and the dictionary file.
+ * @param root The root of the Trie.
+ * @param word The word to delete.
  */
-bool deleteWordHelper(TrieNode *node, const char *word)
+void deleteWord(TrieNode *root, const char *word)
 {
-    // If we haven't reached the end of the word
-    if (*word)
+    // First, check if the word actually exists in the Trie
+    if (containsWord(root, word))
     {
-        int index = *word - 'a';
-        // If the path doesn't exist, the word isn't in the trie
-        if (index < 0 || index >= ALPHABET_SIZE || !node->children[index])
-            return false;
-
-        // Recur for the next character
-        bool shouldDeleteChild = deleteWordHelper(node->children[index], word + 1);
-
-        // If the recursive call indicates the child node should be deleted
-        if (shouldDeleteChild)
-        {
-            free(node->children[index]); // Free the child node's memory
-            node->children[index] = NULL;
-            // Return true if this node is not an end of another word and has no other children
-            return !node->isEndOfWord && isEmpty(node);
-        }
+        removeWord(root, word); // Delete it from the Trie data structure
+        printf(GREEN "Word deleted successfully from Trie.\n" RESET);
+        // Now, remove the word from the dictionary file
+        if (!removeWordFromFile(word))
+            printf(BOLDRED "Error opening dictionary journal!\n" RESET);
     }
-    // If we have reached the end of the word
-    else if (node->isEndOfWord)
+    else
     {
-        node->isEndOfWord = false; // Unmark it as the end of a word
-        // If this node has no children, it's safe to delete
-        return isEmpty(node);
+        printf(BOLDRED "Word not found in Trie.\n" RESET);
     }
-    return false; // Default case
 }
 
 /**
- * @brief Searches for a complete word in the Trie.
+ * @brief Displays all words currently in the dictionary (Trie).
+ * @param root The root node of the Trie.
+ */
+void displayAllWords(TrieNode *root)
+{
+    printf(ORANGE "All words in dictionary:\n" RESET);
+    emitCompletions(root, "", emitSuggestion, NULL); // Every word completes the empty prefix
+}
+
+/**
+ * @brief Displays the shortest and longest word(s) in the dictionary.
  * @param root The root of the Trie.
- * @param word The word to search for.
- * @return true if the word exists, false otherwise.
  */
-bool searchWord(TrieNode *root, const char *word)
+void showShortestLongestWord(TrieNode *root)
 {
-    TrieNode *node = root;
-    while (*word)
+    // The lengths come straight from the length index; only the words themselves are looked up
+    int shortest = shortestWordLength(), longest = longestWordLength();
+    if (!shortest)
     {
-        int index = *word - 'a';
-        if (index < 0 || index >= ALPHABET_SIZE || !node->children[index])
-            return false; // Path does not exist
-        node = node->children[index];
-        word++;
+        printf(BOLDRED "Trie is empty.\n" RESET);
+        return;
     }
-    // The word exists only if the final node is not null AND it's marked as the end of a word
-    return node && node->isEndOfWord;
+
+    printf(MAGENTA "Shortest word(s) (%d characters, %ld words):\n" RESET, shortest, wordsOfLength(shortest));
+    emitWordsOfLength(root, shortest, emitSuggestion, NULL);
+
+    printf(MAGENTA "Longest word(s) (%d characters, %ld words):\n" RESET, longest, wordsOfLength(longest));
+    emitWordsOfLength(root, longest, emitSuggestion, NULL);
 }
 
 /**
- * @brief Deletes a word from the Trie and the dictionary file.
- * @param root The root of the Trie.
- * @param word The word to delete.
+ * @brief Shows all words that have been added during the current program session.
+ * @param sessionWords Array of words added this session.
+ * @param sessionWordCount Count of words in the array.
  */
-void deleteWord(TrieNode *root, const char *word)
+void showRecentlyAdded(char **sessionWords, int sessionWordCount)
 {
-    // First, check if the word actually exists in the Trie
-    if (searchWord(root, word))
+    if (sessionWordCount == 0)
     {
-        deleteWordHelper(root, word); // Delete it from the Trie data structure
-        printf(GREEN "Word deleted successfully from Trie.\n" RESET);
+        printf(YELLOW "No words added during this session.\n" RESET);
+        return;
+    }
+    printf(BOLDYELLOW "Recently Added Words (This Session):\n" RESET);
+    for (int i = 0; i < sessionWordCount; i++)
+    {
+        printf(CYAN " - %s\n" RESET, sessionWords[i]);
+    }
+}
 
-        // Now, remove the word from the dictionary file by rewriting it
-        FILE *file = fopen(DICTIONARY_FILE, "r");
-        FILE *temp = fopen("temp.txt", "w"); // Create a temporary file
-        char line[MAX_WORD_LEN];
-        // Read each line from the original dictionary
-        while (fgets(line, sizeof(line), file))
-        {
-            line[strcspn(line, "\r\n")] = 0; // Remove newline
-            // If the line is not the word to be deleted, write it to the temp file
-            if (strcmp(line, word) != 0)
-                fprintf(temp, "%s\n", line);
-        }
-        fclose(file);
-        fclose(temp);
-        remove(DICTIONARY_FILE);              // Delete the old dictionary
-        rename("temp.txt", DICTIONARY_FILE); // Rename temp file to the original name
+/**
+ * @brief Shows all words that have been deleted during the current program session.
+ * @param deletedSessionWords Array of words deleted this session.
+ * @param deletedSessionWordCount Count of words in the array.
+ */
+void showRecentlyDeleted(char **deletedSessionWords, int deletedSessionWordCount)
+{
+    if (deletedSessionWordCount == 0)
+    {
+        printf(YELLOW "No words deleted during this session.\n" RESET);
+        return;
     }
-    else
+    printf(BOLDRED "Recently Deleted Words (This Session):\n" RESET);
+    for (int i = 0; i < deletedSessionWordCount; i++)
     {
-        printf(BOLDRED "Word not found in Trie.\n" RESET);
+        printf(RED " - %s\n" RESET, deletedSessionWords[i]);
     }
 }
 
 /**
- * @brief Displays all words currently in the dictionary (Trie).
- * @param root The root node of the Trie.
+ * @brief Displays the most frequently searched prefixes from the stats.
  */
-void displayAllWords(TrieNode *root)
+void showMostFrequentSearches()
 {
-    char buffer[MAX_WORD_LEN];
-    printf(ORANGE "All words in dictionary:\n" RESET);
-    collectWords(root, buffer, 0); // Use the recursive collect function from the root
+    WordFrequency *top[TOP_SEARCHES];
+    int count = topSearches(top, TOP_SEARCHES);
+    if (count == 0)
+    {
+        printf(YELLOW "No search history found.\n" RESET);
+        return;
+    }
+    printf(BOLDYELLOW "Most Frequently Searched Words:\n" RESET);
+    for (int i = 0; i < count; i++)
+    {
+        printf(CYAN " - %s (%d times)\n" RESET, top[i]->word, top[i]->frequency);
+    }
 }
 
 /**
- * @brief Recursively finds the shortest and longest words in the Trie.
- * @param node Current node.
- * @param buffer Buffer to build words.
- * @param depth Current depth in Trie.
- * @param shortestWords Array to store shortest words.
- * @param shortestLen Pointer to the length of the current shortest word.
- * @param shortestCount Pointer to the count of shortest words found.
- * @param longestWords Array to store longest words.
- * @param longestLen Pointer to the length of the current longest word.
- * @param longestCount Pointer to the count of longest words found.
+ * @brief Prints the hot-path counters and latency percentiles, then appends them to the metrics file.
  */
-void findShortestLongestWords(
-    TrieNode *node, char *buffer, int depth,
-    char **shortestWords, int *shortestLen, int *shortestCount,
-    char **longestWords, int *longestLen, int *longestCount)
+void showMetrics()
 {
+#if ENABLE_METRICS
+    printf(BOLDCYAN "Performance metrics (latencies in nanoseconds):\n" RESET);
+    char line[128];
+    for (int i = 0; metricLine(i, line, sizeof(line)); i++)
+        printf("%s\n", line);
+    saveMetrics();
+    printf(GREEN "Metrics appended to %s.\n" RESET, METRICS_FILE);
+#else
+    printf(YELLOW "Metrics are disabled in this build.\n" RESET);
+#endif
+    long hits, misses, invalidations, evictions;
+    int entries = prefixCacheStats(&hits, &misses, &invalidations, &evictions);
+    printf(BOLDCYAN "Prefix cache:" RESET " %d entries, %ld hits, %ld misses, %ld invalidated, %ld evicted\n",
+           entries, hits, misses, invalidations, evictions);
+}
 
-    if (node->isEndOfWord)
+// --- BATCH MODE ---
+
+/**
+ * @brief Answers one batch command, writing its results through the current batch writer.
+ * The line is "<command> <word>", one of the argument-less commands "all", "compact" and
+ * "metrics", or just a prefix (short for "suggest <prefix>"; use "suggest all" to complete the prefix "all").
+ * Commands: suggest, page, top, lookup, length, count, rank, select, fuzzy, substring, add, delete, compact, all
+ * and metrics.
+ * "page PREFIX [TOKEN]" returns PAGE_SIZE completions after TOKEN, then "next: <token>" if there are more.
+ * Every command ends with a blank line (text format) or has at least one row (TSV format).
+ * @param root The root node of the Trie.
+ * @param line The command line, without its line break (shorter than BATCH_LINE_SIZE; changed in place).
+ */
+void runBatchCommand(TrieNode *root, char *line)
+{
+    // Split the command from its argument; a line without a command is a prefix to complete
+    const char *command = "suggest";
+    char query[BATCH_LINE_SIZE + 1]; // Room for the command, a space and the argument
+    char *arg = line + strcspn(line, " \t");
+    if (*arg)
+    {
+        *arg++ = '\0';
+        command = line;
+        snprintf(query, sizeof(query), "%s %s", command, arg);
+    }
+    else if (strcmp(line, "all") == 0 || strcmp(line, "compact") == 0 || strcmp(line, "metrics") == 0)
     {
-        buffer[depth] = '\0';
-        int len = strlen(buffer);
+        command = line;
+        strcpy(query, line);
+    }
+    else
+    {
+        arg = line;
+        strcpy(query, line);
+    }
+    reportWriteFailures();
+    foldCase(arg);
+    foldCase(query);
+    batchOutput->query = query;
+    batchOutput->results = 0;
 
-        // Check for shortest word
-        if (*shortestLen == -1 || len < *shortestLen)
+    if (strlen(arg) >= MAX_WORD_LEN)
+    {
+        batchWriteResult("error: word too long");
+    }
+    else if (strcmp(command, "suggest") == 0)
+    {
+        uint64_t start = beginQuery();
+        emitCachedCompletions(root, arg, emitSuggestion, NULL);
+        endQuery(start);
+    }
+    else if (strcmp(command, "compact") == 0)
+    {
+        batchWriteResult(compactDictionary(root) ? "compacted" : "error: compaction failed");
+    }
+    else if (strcmp(command, "all") == 0)
+    {
+        emitCompletions(root, "", emitSuggestion, NULL);
+    }
+    else if (strcmp(command, "metrics") == 0)
+    {
+#if ENABLE_METRICS
+        char metric[128];
+        for (int i = 0; metricLine(i, metric, sizeof(metric)); i++)
+            batchWriteResult(metric);
+        saveMetrics();
+#else
+        batchWriteResult("error: metrics disabled");
+#endif
+    }
+    else if (strcmp(command, "substring") == 0)
+    {
+        // "substring FRAGMENT" lists the words containing the fragment anywhere, from the trigram index
+        if (emitSubstringMatches(root, arg, emitSuggestion, NULL) < 0)
+            batchWriteResult("error: out of memory");
+    }
+    else if (strcmp(command, "lookup") == 0)
+    {
+        batchWriteResult(containsWord(root, arg) ? "found" : "not found");
+    }
+    else if (strcmp(command, "length") == 0)
+    {
+        // "length N" lists every word of N characters; "length shortest|longest" picks N from the index
+        int length = strcmp(arg, "shortest") == 0  ? shortestWordLength()
+                     : strcmp(arg, "longest") == 0 ? longestWordLength()
+                                                   : atoi(arg);
+        emitWordsOfLength(root, length, emitSuggestion, NULL);
+    }
+    else if (strcmp(command, "top") == 0)
+    {
+        if (getEngine() == ENGINE_RADIX)
         {
-            *shortestLen = len;        // Found a new shortest length
-            *shortestCount = 0;        // Reset the count
-            strcpy(shortestWords[(*shortestCount)++], buffer); // Store the new shortest word
+            batchWriteResult("error: ranked suggestions need the trie engine");
         }
-        else if (len == *shortestLen)
+        else
         {
-            strcpy(shortestWords[(*shortestCount)++], buffer); // Found another word of the same shortest length
+            leaveSnapshotEngine(root);
+            WordInfo *results[TOP_K];
+            int count = topKSuggestions(root, arg, results, TOP_K);
+            for (int i = 0; i < count; i++)
+                batchWriteResult(results[i]->word);
         }
-
-        // Check for longest word
-        if (*longestLen == -1 || len > *longestLen)
+    }
+    else if (strcmp(command, "fuzzy") == 0)
+    {
+        // "fuzzy PREFIX [K]" tolerates up to K typos (FUZZY_DISTANCE by default)
+        int distance = FUZZY_DISTANCE;
+        char *limit = strchr(arg, ' ');
+        if (limit)
+        {
+            *limit++ = '\0';
+            distance = atoi(limit);
+        }
+        if (getEngine() == ENGINE_RADIX)
+        {
+            batchWriteResult("error: fuzzy suggestions need the trie engine");
+        }
+        else if (distance < 0 || distance > MAX_FUZZY_DISTANCE)
         {
-            *longestLen = len;       // Found a new longest length
-            *longestCount = 0;       // Reset the count
-            strcpy(longestWords[(*longestCount)++], buffer); // Store the new longest word
+            batchWriteResult("error: distance out of range");
         }
-        else if (len == *longestLen)
+        else
         {
-            strcpy(longestWords[(*longestCount)++], buffer); // Found another word of the same longest length
+            leaveSnapshotEngine(root);
+            FuzzyMatch results[TOP_K];
+            int count = fuzzySuggestions(root, arg, distance, results);
+            for (int i = 0; i < count; i++)
+                batchWriteResult(results[i].info->word);
         }
     }
-
-    // Recur for all children
-    for (int i = 0; i < ALPHABET_SIZE; i++)
+    else if (strcmp(command, "page") == 0)
     {
-        if (node->children[i])
+        // "page PREFIX [TOKEN]" resumes after the token returned with the previous page
+        char *token = strchr(arg, ' ');
+        if (token)
+            *token++ = '\0';
+        if (getEngine() == ENGINE_RADIX)
+        {
+            batchWriteResult("error: paging needs the trie engine");
+        }
+        else
+        {
+            leaveSnapshotEngine(root);
+            CompletionCursor cursor;
+            char words[PAGE_SIZE][MAX_WORD_LEN];
+            int count = cursorOpen(&cursor, root, arg, token) ? cursorNextBatch(&cursor, words, PAGE_SIZE) : 0;
+            for (int i = 0; i < count; i++)
+                batchWriteResult(words[i]);
+            // Peek one word ahead, so the last page does not hand out a token
+            if (count == PAGE_SIZE && cursorNext(&cursor))
+            {
+                char next[MAX_WORD_LEN + 8];
+                snprintf(next, sizeof(next), "next: %s", words[PAGE_SIZE - 1]);
+                batchWriteResult(next);
+            }
+        }
+    }
+    else if (strcmp(command, "count") == 0 || strcmp(command, "rank") == 0 || strcmp(command, "select") == 0)
+    {
+        // "count PREFIX", "rank WORD" and "select K [PREFIX]" answer from the per-node word counts
+        if (getEngine() == ENGINE_RADIX)
+        {
+            batchWriteResult("error: counting needs the trie engine");
+        }
+        else
+        {
+            leaveSnapshotEngine(root);
+            char result[MAX_WORD_LEN];
+            if (strcmp(command, "select") == 0)
+            {
+                char *prefix = strchr(arg, ' ');
+                if (prefix)
+                    *prefix++ = '\0';
+                if (selectWord(root, prefix ? prefix : "", atol(arg), result))
+                    batchWriteResult(result);
+            }
+            else
+            {
+                long value = strcmp(command, "count") == 0 ? countPrefix(root, arg) : rankWord(root, arg);
+                snprintf(result, sizeof(result), "%ld", value);
+                batchWriteResult(result);
+            }
+        }
+    }
+    else if (strcmp(command, "add") == 0)
+    {
+        leaveSnapshotEngine(root);
+        if (containsWord(root, arg))
+        {
+            batchWriteResult("exists");
+        }
+        else
         {
-            buffer[depth] = i + 'a';
-            findShortestLongestWords(
-                node->children[i], buffer, depth + 1,
-                shortestWords, shortestLen, shortestCount,
-                longestWords, longestLen, longestCount);
+            insertWord(root, arg);
+            batchWriteResult(saveWordToFile(arg) ? "added" : "error: journal write failed");
         }
     }
+    else if (strcmp(command, "delete") == 0)
+    {
+        leaveSnapshotEngine(root);
+        if (containsWord(root, arg))
+        {
+            removeWord(root, arg);
+            batchWriteResult(removeWordFromFile(arg) ? "deleted" : "error: journal write failed");
+        }
+        else
+        {
+            batchWriteResult("not found");
+        }
+    }
+    else
+    {
+        batchWriteResult("error: unknown command");
+    }
+
+    // Text output separates queries with a blank line; TSV marks a query without results with an empty value
+    if (batchOutput->format == FORMAT_TSV && batchOutput->results == 0)
+        batchWriteResult("");
+    else if (batchOutput->format == FORMAT_TEXT)
+        batchWrite("\n", 1);
 }
 
 /**
- * @brief Displays the shortest and longest word(s) in the dictionary.
- * @param root The root of the Trie.
+ * @brief Answers a stream of commands without the menu, writing results through one buffered writer.
+ * Each input line is a command for runBatchCommand(). Blank lines and lines starting with '#' are skipped.
+ * Batch queries do not change the search statistics.
+ * @param root The root node of the Trie.
+ * @param input The stream to read commands from.
+ * @param format How results are written (plain text or TSV).
  */
-void showShortestLongestWord(TrieNode *root)
+void runBatch(TrieNode *root, FILE *input, OutputFormat format)
 {
-    char buffer[MAX_WORD_LEN];
-    // Allocate memory for arrays to hold potentially multiple shortest/longest words
-    char *shortestWords[100], *longestWords[100];
-    for (int i = 0; i < 100; i++)
+    static BatchWriter writer; // Static, because the output buffer is too big for the stack
+    writer.stream = stdout;
+    writer.buffer = NULL;
+    writer.used = 0;
+    writer.format = format;
+    batchOutput = &writer;
+
+    char line[BATCH_LINE_SIZE];
+    while (fgets(line, sizeof(line), input))
     {
-        shortestWords[i] = malloc(MAX_WORD_LEN);
-        longestWords[i] = malloc(MAX_WORD_LEN);
+        size_t len = strcspn(line, "\r\n");
+        if (!line[len] && !feof(input))
+        {
+            // The line does not fit the buffer: skip the rest of it and report it
+            int c;
+            while ((c = fgetc(input)) != '\n' && c != EOF)
+                ;
+            fprintf(stderr, "Skipping overlong input line\n");
+            continue;
+        }
+        line[len] = '\0';
+        if (line[0] && line[0] != '#')
+            runBatchCommand(root, line);
     }
 
-    int shortestLen = -1, longestLen = -1; // Initialize lengths to -1 (not found yet)
-    int shortestCount = 0, longestCount = 0;
+    batchFlush();
+    fflush(stdout);
+    batchOutput = NULL;
+}
+
+/**
+ * @brief Releases every engine before the program ends.
+ * A long journal is compacted first, and in snapshot mode the snapshot is rewritten if the Trie
+ * had to be built or modified.
+ * @param root The root node of the Trie.
+ * @param useSnapshot true if the program was started with the snapshot engine.
+ */
+void shutdownEngines(TrieNode *root, bool useSnapshot)
+{
+    stopPersistence(); // Everything queued reaches the files before they are compacted or closed
+    reportWriteFailures();
+    // Fold a long journal back into the dictionary file so the next start replays less
+    if (getJournalRecords() >= JOURNAL_COMPACT_THRESHOLD && !compactDictionary(root))
+        fprintf(stderr, "Error compacting dictionary file!\n");
+    closeJournal();
+    if (useSnapshot && getEngine() == ENGINE_TRIE && !writeSnapshot(root))
+        fprintf(stderr, "Error writing dictionary snapshot!\n");
+    closeSnapshot();
+    closeDoubleArray();
+    freeSubstringIndex();
+    clearPrefixCache();
+    destroyTrie(); // Free every Trie node at once
+    closeRadixTree();
+    freeSearchStats();
+}
 
-    // Call the recursive helper function to find the words
-    findShortestLongestWords(
-        root, buffer, 0,
-        shortestWords, &shortestLen, &shortestCount,
-        longestWords, &longestLen, &longestCount);
+// --- SERVER MODE ---
 
-    // Display the results
-    if (shortestCount > 0 && longestCount > 0)
-    {
-        printf(MAGENTA "Shortest word(s):\n" RESET);
-        for (int i = 0; i < shortestCount; i++)
-            printf(CYAN " - %s\n" RESET, shortestWords[i]);
+/**
+ * @brief Signal handler that asks the server's event loop to stop.
+ * @param signal The signal received (SIGINT or SIGTERM).
+ */
+void stopServer(int signal)
+{
+    (void)signal;
+    serverStopping = 1;
+}
+
+/**
+ * @brief Puts a socket into non-blocking mode.
+ * @param fd The socket.
+ * @return true on success.
+ */
+bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
 
-        printf(MAGENTA "Longest word(s):\n" RESET);
-        for (int i = 0; i < longestCount; i++)
-            printf(CYAN " - %s\n" RESET, longestWords[i]);
+/**
+ * @brief Answers every complete request line buffered for a connection, in the order they arrived.
+ * Pipelined requests are answered in one go; it stops early while too many responses wait to be sent,
+ * leaving the rest in the input buffer.
+ * @param root The root node of the Trie.
+ * @param conn The connection.
+ */
+void serveRequests(TrieNode *root, Connection *conn)
+{
+    static BatchWriter writer; // Static, because the output buffer is too big for the stack
+    writer.buffer = &conn->output;
+    writer.used = 0;
+    writer.format = FORMAT_TEXT; // The blank line after every answer tells clients where it ends
+    batchOutput = &writer;
+
+    // The last request of a client that closed its side may lack its line break
+    if (conn->closing && conn->inputUsed > 0 && conn->inputUsed < SERVER_INPUT_SIZE &&
+        conn->input[conn->inputUsed - 1] != '\n')
+        conn->input[conn->inputUsed++] = '\n';
+
+    char *start = conn->input, *end = conn->input + conn->inputUsed;
+    char *newline;
+    while (conn->output.used - conn->output.sent < SERVER_OUTPUT_LIMIT &&
+           (newline = memchr(start, '\n', end - start)))
+    {
+        char *line = start;
+        start = newline + 1;
+        *newline = '\0';
+        if (conn->skipping)
+        {
+            conn->skipping = false; // The end of the overlong line that was already answered
+            continue;
+        }
+        line[strcspn(line, "\r")] = '\0';
+        if (newline - line >= BATCH_LINE_SIZE - 1)
+        {
+            batchWriteResult("error: line too long");
+            batchWrite("\n", 1);
+        }
+        else if (line[0] && line[0] != '#')
+            runBatchCommand(root, line);
     }
-    else
+    memmove(conn->input, start, end - start);
+    conn->inputUsed = end - start;
+
+    // A full buffer without a line break is an overlong line: answer it and drop it as it arrives
+    if (conn->inputUsed == SERVER_INPUT_SIZE)
     {
-        printf(BOLDRED "Trie is empty.\n" RESET);
+        batchWriteResult("error: line too long");
+        batchWrite("\n", 1);
+        conn->inputUsed = 0;
+        conn->skipping = true;
     }
+    batchOutput = NULL;
+}
 
-    // Free the allocated memory
-    for (int i = 0; i < 100; i++)
+/**
+ * @brief Sends as many pending responses as the socket accepts without blocking.
+ * @param conn The connection.
+ * @return false if the connection failed and has to be closed.
+ */
+bool sendResponses(Connection *conn)
+{
+    OutputBuffer *output = &conn->output;
+    while (output->sent < output->used)
     {
-        free(shortestWords[i]);
-        free(longestWords[i]);
+        ssize_t written = send(conn->fd, output->data + output->sent, output->used - output->sent, MSG_NOSIGNAL);
+        if (written < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        output->sent += written;
     }
+    output->used = output->sent = 0; // Everything is out, so the buffer starts over
+    return true;
 }
 
 /**
- * @brief Shows all words that have been added during the current program session.
- * @param sessionWords Array of words added this session.
- * @param sessionWordCount Count of words in the array.
+ * @brief Closes a connection and frees it.
+ * @param connections The list of open connections.
+ * @param conn The connection to close.
  */
-void showRecentlyAdded(char **sessionWords, int sessionWordCount)
+void closeConnection(Connection **connections, Connection *conn)
 {
-    if (sessionWordCount == 0)
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        *connections = conn->next;
+    if (conn->next)
+        conn->next->prev = conn->prev;
+    close(conn->fd); // Also removes it from the epoll set
+    free(conn->output.data);
+    free(conn);
+}
+
+/**
+ * @brief Reads, answers and sends for one connection that has a socket event, then re-arms it.
+ * The connection only asks for input while it has room for it and its unsent responses are
+ * below SERVER_OUTPUT_LIMIT, so a client that does not read its answers cannot grow them forever.
+ * @param root The root node of the Trie.
+ * @param epoll The epoll instance.
+ * @param connections The list of open connections.
+ * @param conn The connection.
+ * @param events The epoll events reported for it.
+ */
+void serviceConnection(TrieNode *root, int epoll, Connection **connections, Connection *conn, uint32_t events)
+{
+    bool ok = true;
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !conn->closing)
     {
-        printf(YELLOW "No words added during this session.\n" RESET);
+        ssize_t received = recv(conn->fd, conn->input + conn->inputUsed, SERVER_INPUT_SIZE - conn->inputUsed, 0);
+        if (received > 0)
+            conn->inputUsed += received;
+        else if (received == 0)
+            conn->closing = true; // The client sent everything it had
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            ok = false;
+    }
+    if (ok)
+    {
+        serveRequests(root, conn);
+        ok = !conn->output.failed && sendResponses(conn);
+    }
+    bool pending = conn->output.sent < conn->output.used;
+    if (!ok || (conn->closing && !pending && !memchr(conn->input, '\n', conn->inputUsed)))
+    {
+        closeConnection(connections, conn);
         return;
     }
-    printf(BOLDYELLOW "Recently Added Words (This Session):\n" RESET);
-    for (int i = 0; i < sessionWordCount; i++)
+
+    struct epoll_event event = {0};
+    event.data.ptr = conn;
+    if (!conn->closing && conn->inputUsed < SERVER_INPUT_SIZE &&
+        conn->output.used - conn->output.sent < SERVER_OUTPUT_LIMIT)
+        event.events |= EPOLLIN;
+    if (pending)
+        event.events |= EPOLLOUT;
+    epoll_ctl(epoll, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+/**
+ * @brief Accepts every connection waiting on the listening socket.
+ * @param epoll The epoll instance the connections are added to.
+ * @param listener The listening socket.
+ * @param connections The list of open connections.
+ */
+void acceptConnections(int epoll, int listener, Connection **connections)
+{
+    int fd;
+    while ((fd = accept(listener, NULL, NULL)) >= 0)
     {
-        printf(CYAN " - %s\n" RESET, sessionWords[i]);
+        Connection *conn = (Connection *)calloc(1, sizeof(Connection));
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (!conn || !setNonBlocking(fd) || epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->next = *connections;
+        if (*connections)
+            (*connections)->prev = conn;
+        *connections = conn;
     }
 }
 
 /**
- * @brief Shows all words that have been deleted during the current program session.
- * @param deletedSessionWords Array of words deleted this session.
- * @param deletedSessionWordCount Count of words in the array.
+ * @brief Serves batch commands to local clients over a Unix domain socket until SIGINT or SIGTERM.
+ * A single thread multiplexes every connection with epoll, so the Trie needs no locking. Each
+ * request is one batch command line; clients may pipeline any number of them, and the answers
+ * come back in request order, each in text format ending with a blank line. As in batch mode,
+ * queries do not change the search statistics.
+ * @param root The root node of the Trie.
+ * @param path The socket path (an existing socket file there is replaced).
+ * @return 0 after a clean stop, 1 if the socket could not be set up.
  */
-void showRecentlyDeleted(char **deletedSessionWords, int deletedSessionWordCount)
+int runServer(TrieNode *root, const char *path)
 {
-    if (deletedSessionWordCount == 0)
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
     {
-        printf(YELLOW "No words deleted during this session.\n" RESET);
-        return;
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 1;
     }
-    printf(BOLDRED "Recently Deleted Words (This Session):\n" RESET);
-    for (int i = 0; i < deletedSessionWordCount; i++)
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    int epoll = epoll_create1(0);
+    unlink(path); // A socket file left by an earlier server would make bind() fail
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // Marks the listening socket
+    if (listener < 0 || epoll < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0 || !setNonBlocking(listener) ||
+        epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event) != 0)
     {
-        printf(RED " - %s\n" RESET, deletedSessionWords[i]);
+        perror("Cannot serve on socket");
+        if (listener >= 0)
+            close(listener);
+        if (epoll >= 0)
+            close(epoll);
+        return 1;
     }
+
+    // Stop on SIGINT/SIGTERM without SA_RESTART, so epoll_wait returns; a client that goes away
+    // mid-answer must not kill the server
+    struct sigaction action = {0};
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving on %s\n", path);
+    fflush(stdout);
+
+    Connection *connections = NULL;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!serverStopping)
+    {
+        int count = epoll_wait(epoll, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.ptr)
+                serviceConnection(root, epoll, &connections, events[i].data.ptr, events[i].events);
+            else
+                acceptConnections(epoll, listener, &connections);
+        }
+    }
+
+    while (connections)
+        closeConnection(&connections, connections);
+    close(epoll);
+    close(listener);
+    unlink(path);
+    return 0;
 }
 
+// --- BENCHMARK FUNCTIONS ---
+
 /**
- * @brief Displays the most frequently searched prefixes from the stats.
+ * @brief Returns the next number of a xorshift64* pseudo-random sequence.
+ * Deterministic, so the same seed always produces the same synthetic dictionary.
+ * @param state The generator state (must not be 0); advanced by the call.
+ * @return A 64-bit pseudo-random number.
  */
-void showMostFrequentSearches()
+uint64_t benchRandom(uint64_t *state)
 {
-    if (wordFreqCount == 0)
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Picks an index with probability proportional to its weight.
+ * @param state The random generator state.
+ * @param weights The weights.
+ * @param count The number of weights.
+ * @return The chosen index.
+ */
+int benchPick(uint64_t *state, const int *weights, int count)
+{
+    int total = 0;
+    for (int i = 0; i < count; i++)
+        total += weights[i];
+    int r = (int)(benchRandom(state) % (uint64_t)total);
+    int i = 0;
+    while (r >= weights[i])
+        r -= weights[i++];
+    return i;
+}
+
+/**
+ * @brief Generates one synthetic English-like word.
+ * First letters follow the share of dictionary words starting with each letter, later letters follow
+ * English letter frequencies, and common prefixes and suffixes make many words share long paths,
+ * like a real dictionary does.
+ * @param state The random generator state.
+ * @param word Buffer of BENCH_WORD_LEN bytes that receives the word.
+ */
+void generateWord(uint64_t *state, char *word)
+{
+    static const int firstLetters[BENCH_LETTERS] = {60, 55, 95, 60, 42, 40, 32, 37, 35, 8, 10, 32, 55,
+                                                    22, 25, 80, 5, 55, 110, 52, 30, 15, 25, 1, 4, 3};
+    static const int letters[BENCH_LETTERS] = {82, 15, 28, 43, 127, 22, 20, 61, 70, 2, 8, 40, 24,
+                                               67, 75, 19, 1, 60, 63, 91, 28, 10, 24, 2, 20, 1};
+    static const int lengths[] = {0, 0, 2, 6, 10, 13, 14, 14, 12, 10, 8, 5, 3, 2, 1}; // Index = letters
+    static const char *prefixes[] = {"un", "re", "in", "dis", "pre", "over", "con", "com", "de", "ex",
+                                     "pro", "trans", "sub", "inter", "anti", "mis", "non", "out"};
+    static const char *suffixes[] = {"ing", "ed", "s", "tion", "ly", "er", "ness", "able", "ment", "est"};
+    int prefixCount = sizeof(prefixes) / sizeof(prefixes[0]);
+    int suffixCount = sizeof(suffixes) / sizeof(suffixes[0]);
+
+    int len = 0;
+    uint64_t shape = benchRandom(state) % 100;
+    if (shape < 30)
     {
-        printf(YELLOW "No search history found.\n" RESET);
-        return;
+        // Zipf-like choice of a common prefix: earlier entries are picked more often
+        const char *prefix = prefixes[benchRandom(state) % prefixCount * (benchRandom(state) % prefixCount) / prefixCount];
+        strcpy(word, prefix);
+        len = strlen(prefix);
     }
-    printf(BOLDYELLOW "Most Frequently Searched Words:\n" RESET);
-    // Note: This just lists them; for a true "most frequent", it would need to be sorted.
-    for (int i = 0; i < wordFreqCount; i++)
+    else
+        word[len++] = 'a' + benchPick(state, firstLetters, BENCH_LETTERS);
+
+    int target = benchPick(state, lengths, sizeof(lengths) / sizeof(lengths[0]));
+    while (len < target || len < 2)
+        word[len++] = 'a' + benchPick(state, letters, BENCH_LETTERS);
+
+    if (benchRandom(state) % 100 < 35)
+    {
+        const char *suffix = suffixes[benchRandom(state) % suffixCount];
+        strcpy(word + len, suffix);
+        len += strlen(suffix);
+    }
+    word[len] = '\0';
+}
+
+/**
+ * @brief Writes a synthetic dictionary, one word per line.
+ * @param file The file to write to.
+ * @param words The number of words to generate (duplicates are possible, as in real word lists).
+ * @param seed The random seed.
+ * @return true on success, false on a write error.
+ */
+bool writeSyntheticDictionary(FILE *file, long words, uint64_t seed)
+{
+    uint64_t state = seed;
+    char word[BENCH_WORD_LEN];
+    for (long i = 0; i < words; i++)
     {
-        printf(CYAN " - %s (%d times)\n" RESET, wordFreqList[i].word, wordFreqList[i].frequency);
+        generateWord(&state, word);
+        fputs(word, file);
+        fputc('\n', file);
     }
+    return !ferror(file);
+}
+
+/**
+ * @brief Returns the peak resident set size of the process so far.
+ * @return The peak RSS in kilobytes.
+ */
+long peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * @brief qsort comparator for uint64_t values, ascending.
+ */
+int compareLatencies(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Prints one benchmark result as a JSON object.
+ * @param name The name of the benchmarked function.
+ * @param latencies Per-operation latencies in nanoseconds (sorted by this function).
+ * @param ops The number of timed operations.
+ * @param allocations Allocations counted during the operations.
+ * @param last true if this is the last result of its run (no trailing comma).
+ */
+void reportBenchResult(const char *name, uint64_t *latencies, long ops, unsigned long long allocations, bool last)
+{
+    uint64_t total = 0;
+    for (long i = 0; i < ops; i++)
+        total += latencies[i];
+    qsort(latencies, ops, sizeof(uint64_t), compareLatencies);
+
+    printf("        {\"name\": \"%s\", \"ops\": %ld, \"total_ns\": %llu, \"ops_per_sec\": %.1f, "
+           "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, "
+           "\"allocations_per_op\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+           name, ops, (unsigned long long)total, total ? ops * 1e9 / total : 0.0,
+           (unsigned long long)latencies[ops / 2], (unsigned long long)latencies[ops * 9 / 10],
+           (unsigned long long)latencies[ops * 99 / 100], (unsigned long long)latencies[ops - 1],
+           (double)allocations / ops, peakRssKb(), last ? "" : ",");
 }
 
 /**
- * @brief Loads search statistics from the stats file at the start of the program.
+ * @brief Benchmarks the Trie hot paths on one synthetic dictionary size.
+ * Must run inside an empty scratch directory, since it writes DICTIONARY_FILE there.
+ * @param words The number of dictionary words.
+ * @param last true if this is the last size (no trailing comma).
+ * @return true on success, false if the dictionary or buffers could not be created.
  */
-void loadSearchStats()
+bool runBenchmarkSize(long words, bool last)
 {
-    FILE *file = fopen(STATS_FILE, "r");
+    FILE *file = fopen(DICTIONARY_FILE, "w");
     if (!file)
-        return; // If file doesn't exist, just return silently
+        return false;
+    bool written = writeSyntheticDictionary(file, words, BENCH_SEED);
+    if (fclose(file) != 0 || !written)
+        return false;
 
-    char word[MAX_WORD_LEN];
-    int freq;
+    long ops = words < BENCH_OPERATIONS ? words : BENCH_OPERATIONS;
+    long loads = words <= 100000 ? 5 : 1; // Repeat small loads so their timing is meaningful
+    long collects = ops < BENCH_COLLECT_OPERATIONS ? ops : BENCH_COLLECT_OPERATIONS;
+    uint64_t *latencies = (uint64_t *)malloc(ops * sizeof(uint64_t));
+    char (*extra)[BENCH_WORD_LEN] = malloc(ops * sizeof(*extra));  // Words inserted and removed again
+    char (*misses)[BENCH_WORD_LEN] = malloc(ops * sizeof(*misses)); // Words looked up that may be absent
+    if (!latencies || !extra || !misses)
+    {
+        free(latencies);
+        free(extra);
+        free(misses);
+        return false;
+    }
+    uint64_t state = BENCH_SEED * 3 + words;
+    for (long i = 0; i < ops; i++)
+    {
+        generateWord(&state, extra[i]);
+        strcat(extra[i], "q"); // 'q' endings are rare, so most of these words are new
+        generateWord(&state, misses[i]);
+    }
 
-    // Read word and frequency pairs from the file
-    while (fscanf(file, "%s %d", word, &freq) == 2)
+    printf("    {\"words\": %ld, \"results\": [\n", words);
+    TrieNode *root = NULL;
+    unsigned long long allocations;
+    uint64_t start;
+
+    // loadDictionary: one operation is a whole load into an empty Trie
+    allocations = 0;
+    for (long i = 0; i < loads; i++)
     {
-        strcpy(wordFreqList[wordFreqCount].word, word);
-        wordFreqList[wordFreqCount].frequency = freq;
-        wordFreqCount++;
+        destroyTrie();
+        root = createNode();
+        unsigned long long before = getAllocationCount();
+        start = nowNanoseconds();
+        loadDictionary(root);
+        latencies[i] = nowNanoseconds() - start;
+        allocations += getAllocationCount() - before;
     }
+    reportBenchResult("loadDictionary", latencies, loads, allocations, false);
 
-    fclose(file);
+    // insert: new words into the loaded Trie
+    allocations = getAllocationCount();
+    for (long i = 0; i < ops; i++)
+    {
+        start = nowNanoseconds();
+        insert(root, extra[i]);
+        latencies[i] = nowNanoseconds() - start;
+    }
+    reportBenchResult("insert", latencies, ops, getAllocationCount() - allocations, false);
+
+    // searchWord: alternate guaranteed hits with lookups of random words
+    allocations = getAllocationCount();
+    for (long i = 0; i < ops; i++)
+    {
+        const char *word = i % 2 ? misses[i] : extra[i];
+        start = nowNanoseconds();
+        benchSink = searchWord(root, word);
+        latencies[i] = nowNanoseconds() - start;
+    }
+    reportBenchResult("searchWord", latencies, ops, getAllocationCount() - allocations, false);
+
+    // searchPrefix: prefixes of 1 to 4 letters
+    allocations = getAllocationCount();
+    for (long i = 0; i < ops; i++)
+    {
+        char prefix[5];
+        snprintf(prefix, sizeof(prefix), "%.*s", (int)(i % 4 + 1), extra[i]);
+        start = nowNanoseconds();
+        benchSink = (uintptr_t)searchPrefix(root, prefix);
+        latencies[i] = nowNanoseconds() - start;
+    }
+    reportBenchResult("searchPrefix", latencies, ops, getAllocationCount() - allocations, false);
+
+    // buildDoubleArray and its searchWord: the same lookups through the compiled BASE/CHECK arrays
+    allocations = getAllocationCount();
+    start = nowNanoseconds();
+    bool compiled = buildDoubleArray(root);
+    latencies[0] = nowNanoseconds() - start;
+    reportBenchResult("buildDoubleArray", latencies, 1, getAllocationCount() - allocations, false);
+    if (compiled)
+    {
+        setEngine(ENGINE_DOUBLE_ARRAY);
+        allocations = getAllocationCount();
+        for (long i = 0; i < ops; i++)
+        {
+            const char *word = i % 2 ? misses[i] : extra[i];
+            start = nowNanoseconds();
+            benchSink = containsWord(root, word);
+            latencies[i] = nowNanoseconds() - start;
+        }
+        reportBenchResult("doubleArraySearchWord", latencies, ops, getAllocationCount() - allocations, false);
+        setEngine(ENGINE_TRIE);
+        closeDoubleArray();
+    }
+
+    // collectWords: enumerate every completion of a 3-letter prefix into a sink that only counts them
+    allocations = getAllocationCount();
+    long collected = 0;
+    long long completions = 0;
+    for (long i = 0; i < ops && collected < collects; i++)
+    {
+        char buffer[MAX_WORD_LEN];
+        snprintf(buffer, sizeof(buffer), "%.3s", extra[i]);
+        TrieNode *from = searchPrefix(root, buffer);
+        if (!from)
+            continue;
+        start = nowNanoseconds();
+        collectWords(from, buffer, strlen(buffer), countWord, &completions);
+        latencies[collected++] = nowNanoseconds() - start;
+    }
+    benchSink = completions;
+    if (collected)
+        reportBenchResult("collectWords", latencies, collected, getAllocationCount() - allocations, false);
+
+    // cachedCompletions: a few hot 3-letter prefixes over and over; all but their first queries are cache hits
+    allocations = getAllocationCount();
+    for (long i = 0; i < collects; i++)
+    {
+        char prefix[4];
+        snprintf(prefix, sizeof(prefix), "%.3s", extra[i % BENCH_HOT_PREFIXES]);
+        start = nowNanoseconds();
+        emitCachedCompletions(root, prefix, countWord, &completions);
+        latencies[i] = nowNanoseconds() - start;
+    }
+    benchSink = completions;
+    reportBenchResult("cachedCompletions", latencies, collects, getAllocationCount() - allocations, false);
+    clearPrefixCache();
+
+    // removeWord: delete the inserted words again (the in-memory part of deleteWord)
+    allocations = getAllocationCount();
+    for (long i = 0; i < ops; i++)
+    {
+        start = nowNanoseconds();
+        removeWord(root, extra[i]);
+        latencies[i] = nowNanoseconds() - start;
+    }
+    reportBenchResult("removeWord", latencies, ops, getAllocationCount() - allocations, false);
+
+    // updateFrequency, then sketchUpdateFrequency: count searches of mostly distinct words exactly,
+    // then in the fixed-size sketch
+    StatsMode mode = getStatsMode();
+    for (int sketched = 0; sketched <= 1; sketched++)
+    {
+        setStatsMode(sketched ? STATS_SKETCH : STATS_EXACT);
+        allocations = getAllocationCount();
+        for (long i = 0; i < ops; i++)
+        {
+            start = nowNanoseconds();
+            benchSink = updateFrequency(misses[i]);
+            latencies[i] = nowNanoseconds() - start;
+        }
+        reportBenchResult(sketched ? "sketchUpdateFrequency" : "updateFrequency", latencies, ops,
+                          getAllocationCount() - allocations, false);
+        freeSearchStats();
+    }
+    setStatsMode(mode);
+
+    // shortestLongestWords: length index lookups plus every word of the shortest and longest length
+    long shortestLongest = 0;
+    allocations = getAllocationCount();
+    for (long i = 0; i < loads; i++)
+    {
+        long long listed = 0;
+        start = nowNanoseconds();
+        emitWordsOfLength(root, shortestWordLength(), countWord, &listed);
+        emitWordsOfLength(root, longestWordLength(), countWord, &listed);
+        latencies[i] = nowNanoseconds() - start;
+        shortestLongest += listed;
+    }
+    benchSink = shortestLongest;
+    reportBenchResult("shortestLongestWords", latencies, loads, getAllocationCount() - allocations, true);
+    printf("    ]}%s\n", last ? "" : ",");
+
+    free(latencies);
+    free(extra);
+    free(misses);
+    return true;
 }
 
 /**
- * @brief Saves the current search statistics to the stats file before exiting.
+ * @brief Runs the benchmark suite on synthetic dictionaries of 1K words up to maxWords (x10 each step)
+ * and prints the results as JSON on stdout.
+ * Everything happens in a scratch directory, so the real dictionary, journal and statistics are untouched.
+ * @param maxWords The largest dictionary size.
+ * @return 0 on success, 1 on failure.
  */
-void saveSearchStats()
+int runBenchmarks(long maxWords)
 {
-    FILE *file = fopen(STATS_FILE, "w"); // Open in write mode to overwrite old stats
-    if (!file)
-        return;
-
-    // Write each tracked word and its frequency to the file
-    for (int i = 0; i < wordFreqCount; i++)
+    char home[4096];
+    const char *tmp = getenv("TMPDIR");
+    char scratch[4096];
+    snprintf(scratch, sizeof(scratch), "%s/trie-bench-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!getcwd(home, sizeof(home)) || !mkdtemp(scratch) || chdir(scratch) != 0)
     {
-        fprintf(file, "%s %d\n", wordFreqList[i].word, wordFreqList[i].frequency);
+        fprintf(stderr, "Cannot create a scratch directory for the benchmark\n");
+        return 1;
     }
 
-    fclose(file);
+    printf("{\n  \"benchmark\": \"trie\",\n  \"load_threads\": %d,\n  \"text_scan\": \"%s\",\n  \"seed\": %llu,\n"
+           "  \"runs\": [\n",
+           getLoadThreads(), textScannerName(), (unsigned long long)BENCH_SEED);
+    bool ok = true;
+    for (long words = 1000; words <= maxWords && ok; words *= 10)
+        ok = runBenchmarkSize(words, words * 10 > maxWords);
+    printf("  ]\n}\n");
+    fflush(stdout);
+
+    destroyTrie();
+    freeSearchStats();
+    unlink(DICTIONARY_FILE);
+    if (chdir(home) != 0 || rmdir(scratch) != 0)
+        fprintf(stderr, "Cannot remove the benchmark scratch directory %s\n", scratch);
+    if (!ok)
+        fprintf(stderr, "Benchmark failed\n");
+    return ok ? 0 : 1;
 }
 
 // --- MAIN FUNCTION ---
 
-int main()
+int main(int argc, char *argv[])
 {
+    FILE *batchInput = stdin;   // Where batch commands are read from
+    OutputFormat format = FORMAT_TEXT;
+    int stressReaders = 0;      // Number of reader threads for the concurrency stress run (0 = off)
+    double stressSeconds = STRESS_SECONDS; // Length of the concurrency stress run
+    long benchWords = 0;        // Largest dictionary size for the benchmark suite (0 = no benchmark)
+    long generateWords = 0;     // Words of synthetic dictionary to print (0 = none)
+    const char *serverSocket = NULL; // Socket path to serve queries on (NULL = no server)
+    bool writeBehind = true;    // Whether a background thread writes the journal and search counts
+    int prewarmPrefixes = 0;    // Most searched prefixes to cache before the first query (0 = none)
+
+    // Pick the storage engine ("--engine=radix" selects the path-compressed radix tree) and the mode
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--engine=radix") == 0)
+            setEngine(ENGINE_RADIX);
+        else if (strcmp(argv[i], "--engine=trie") == 0)
+            setEngine(ENGINE_TRIE);
+        else if (strcmp(argv[i], "--engine=snapshot") == 0)
+            setEngine(ENGINE_SNAPSHOT);
+        else if (strcmp(argv[i], "--engine=double-array") == 0)
+            setEngine(ENGINE_DOUBLE_ARRAY);
+        else if (strcmp(argv[i], "--batch") == 0)
+            batchMode = true;
+        else if (strncmp(argv[i], "--batch=", 8) == 0)
+        {
+            batchMode = true;
+            batchInput = fopen(argv[i] + 8, "r");
+            if (!batchInput)
+            {
+                fprintf(stderr, "Cannot open batch input file: %s\n", argv[i] + 8);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--concurrent-readers=", 21) == 0)
+            stressReaders = atoi(argv[i] + 21);
+        else if (strncmp(argv[i], "--stress-seconds=", 17) == 0 && atof(argv[i] + 17) > 0)
+            stressSeconds = atof(argv[i] + 17);
+        else if (strcmp(argv[i], "--serve") == 0 || strncmp(argv[i], "--serve=", 8) == 0)
+        {
+            serverSocket = argv[i][7] ? argv[i] + 8 : SERVER_SOCKET;
+            batchMode = true; // The server keeps status messages off stdout too
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+            benchWords = BENCH_DEFAULT_MAX_WORDS;
+        else if (strncmp(argv[i], "--bench=", 8) == 0)
+            benchWords = atol(argv[i] + 8);
+        else if (strncmp(argv[i], "--generate-dictionary=", 22) == 0)
+            generateWords = atol(argv[i] + 22);
+        else if (strncmp(argv[i], "--load-threads=", 15) == 0)
+        {
+            int threads = atoi(argv[i] + 15);
+            if (threads <= 0)
+                threads = (int)sysconf(_SC_NPROCESSORS_ONLN); // 0 = one thread per online CPU
+            setLoadThreads(threads);
+        }
+        else if (strcmp(argv[i], "--text-scan=auto") == 0)
+            setTextScanner(SCAN_AUTO);
+        else if (strcmp(argv[i], "--text-scan=scalar") == 0)
+            setTextScanner(SCAN_SCALAR);
+        else if (strcmp(argv[i], "--text-scan=sse2") == 0)
+            setTextScanner(SCAN_SSE2);
+        else if (strcmp(argv[i], "--text-scan=avx2") == 0)
+            setTextScanner(SCAN_AVX2);
+        else if (strcmp(argv[i], "--stats=exact") == 0)
+            setStatsMode(STATS_EXACT);
+        else if (strcmp(argv[i], "--stats=sketch") == 0)
+            setStatsMode(STATS_SKETCH);
+        else if (strncmp(argv[i], "--stats-half-life=", 18) == 0 && atof(argv[i] + 18) > 0)
+            setSketchHalfLife(atof(argv[i] + 18));
+        else if (strncmp(argv[i], "--prefix-cache=", 15) == 0 && atol(argv[i] + 15) >= 0)
+            setPrefixCacheLimit((size_t)atol(argv[i] + 15) << 20); // MiB; 0 turns the cache off
+        else if (strcmp(argv[i], "--prewarm-cache") == 0)
+            prewarmPrefixes = PREFIX_CACHE_PREWARM;
+        else if (strncmp(argv[i], "--prewarm-cache=", 16) == 0)
+            prewarmPrefixes = atoi(argv[i] + 16);
+        else if (strcmp(argv[i], "--lazy-substring-index") == 0)
+            setSubstringIndexing(false); // Built by the first substring query instead of while loading
+        else if (strcmp(argv[i], "--sync-writes") == 0)
+            writeBehind = false;
+        else if (strcmp(argv[i], "--format=tsv") == 0)
+            format = FORMAT_TSV;
+        else if (strcmp(argv[i], "--format=text") == 0)
+            format = FORMAT_TEXT;
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n"
+                            "Usage: %s [--engine=trie|--engine=radix|--engine=snapshot|--engine=double-array]\n"
+                            "       [--batch[=FILE]] [--format=text|tsv]\n"
+                            "       [--load-threads=N] [--text-scan=auto|scalar|sse2|avx2]\n"
+                            "       [--stats=exact|sketch] [--stats-half-life=SECONDS] [--sync-writes]\n"
+                            "       [--lazy-substring-index] [--prefix-cache=MIB] [--prewarm-cache[=N]]\n"
+                            "       %s --serve[=SOCKET_PATH] | --concurrent-readers=N [--stress-seconds=S]\n"
+                            "       %s --bench[=MAX_WORDS] | --generate-dictionary=N\n",
+                    argv[i], argv[0], argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    // The benchmark and the dictionary generator work on synthetic data and replace the menu
+    if (generateWords > 0)
+        return writeSyntheticDictionary(stdout, generateWords, BENCH_SEED) ? 0 : 1;
+    if (benchWords > 0)
+    {
+        if (getEngine() != ENGINE_TRIE)
+        {
+            fprintf(stderr, "--bench measures the trie engine\n");
+            return 1;
+        }
+        return runBenchmarks(benchWords);
+    }
+
     TrieNode *root = createNode(); // Create the root of the Trie
-    loadDictionary(root);          // Load existing words from the file
-    loadSearchStats();             // Load previous search statistics
+
+    // The snapshot engine only needs the text dictionary when the snapshot is missing or stale
+    bool useSnapshot = getEngine() == ENGINE_SNAPSHOT;
+    if (useSnapshot)
+    {
+        if (isSnapshotFresh() && openSnapshot())
+        {
+            if (!batchMode)
+                printf(GREEN "Dictionary snapshot mapped successfully!\n" RESET);
+        }
+        else
+            setEngine(ENGINE_TRIE); // Build the Trie from text; the snapshot is rewritten at exit
+    }
+    loadSearchStats();             // Load previous search statistics (first, so new words are ranked)
+    if (getEngine() != ENGINE_SNAPSHOT)
+    {
+        // Load existing words from the file; a missing file leaves the trie empty (warn on stderr in batch mode)
+        if (!loadDictionary(root))
+        {
+            if (batchMode)
+                fprintf(stderr, "Warning: Dictionary file not found. Proceeding with an empty trie.\n");
+            else
+                printf(ORANGE "Warning: Dictionary file not found. Proceeding with an empty trie.\n" RESET);
+        }
+        else if (!batchMode)
+            printf(GREEN "Dictionary loaded successfully!\n" RESET);
+    }
+    if (getJournalRecords() >= JOURNAL_COMPACT_THRESHOLD && !compactDictionary(root))
+        fprintf(stderr, "Error compacting dictionary file!\n"); // Keep the journal; it is still replayed
+
+    // The concurrency stress run uses the Trie engine and replaces the menu
+    if (stressReaders)
+    {
+        if (getEngine() != ENGINE_TRIE)
+        {
+            fprintf(stderr, "--concurrent-readers needs the trie engine\n");
+            shutdownEngines(root, false);
+            return 1;
+        }
+        int status = 1; // 0 only for a run without inconsistencies
+        StressReport report;
+        if (stressReaders < 1 || stressReaders > MAX_READERS)
+            fprintf(stderr, "The number of readers must be between 1 and %d\n", MAX_READERS);
+        else if (isEmpty(root))
+            fprintf(stderr, "The dictionary is empty\n");
+        else if (runConcurrencyStress(root, stressReaders, stressSeconds, &report))
+        {
+            printf("readers=%d reads=%lld reads_per_sec=%.0f writes=%ld errors=%lld\n", report.readers,
+                   report.reads, report.reads / report.seconds, report.writes, report.errors);
+            status = report.errors ? 1 : 0;
+        }
+        else
+            fprintf(stderr, "Error starting the reader threads!\n");
+        shutdownEngines(root, false);
+        return status;
+    }
+
+    // Materialize the completions of the prefixes searched most in earlier sessions
+    if (prewarmPrefixes > 0)
+    {
+        int warmed = prewarmPrefixCache(root, prewarmPrefixes);
+        if (!batchMode)
+            printf(GREEN "Prefix cache warmed with %d prefixes.\n" RESET, warmed);
+    }
+
+    // From here on, updates and searches only queue their file writes (--sync-writes writes them inline)
+    if (writeBehind && !startPersistence())
+        fprintf(stderr, "Cannot start the write-behind thread; writing synchronously\n");
+
+    if (serverSocket)
+    {
+        int status = runServer(root, serverSocket);
+        shutdownEngines(root, useSnapshot); // Server queries leave the search statistics untouched
+        return status;
+    }
+
+    if (batchMode)
+    {
+        runBatch(root, batchInput, format);
+        if (batchInput != stdin)
+            fclose(batchInput);
+        shutdownEngines(root, useSnapshot); // Batch queries leave the search statistics untouched
+        return 0;
+    }
 
     int choice;
     char word[MAX_WORD_LEN];
@@ -602,6 +1623,7 @@ int main()
     // Main program loop
     while (1)
     {
+        reportWriteFailures();
         // Display the menu
         printf("\n" BOLDCYAN "--- Auto-Suggest System ---\n" RESET);
         printf("\x1b[38;5;208m"); // Orange color for menu options
@@ -614,7 +1636,13 @@ int main()
         printf("7. Show recently deleted words\n");
         printf("8. Undo last deleted word\n");
         printf("9. Show most frequently searched words\n");
-        printf("10. Exit\n");
+        printf("10. Show top-ranked suggestions for a prefix\n");
+        printf("11. Compact dictionary file\n");
+        printf("12. Typo-tolerant suggestions for a prefix\n");
+        printf("13. Show performance metrics\n");
+        printf("14. Browse suggestions page by page\n");
+        printf("15. Search words containing a fragment\n");
+        printf("16. Exit\n");
         printf(RESET "Enter your choice: ");
         scanf("%d", &choice);
         getchar(); // Consume the newline character left by scanf
@@ -622,11 +1650,14 @@ int main()
         switch (choice)
         {
         case 1: // Add a new word
+            leaveSnapshotEngine(root); // The snapshot is read-only
             printf(GREY "Enter word to add: " RESET);
             scanf("%s", word);
-            toLowerCase(word);
-            insert(root, word);
-            saveWordToFile(word); // Persist the new word to the dictionary file
+            foldCase(word);
+            insertWord(root, word);
+            // Persist the new word to the dictionary file
+            if (!saveWordToFile(word))
+                printf(BOLDRED "Error opening dictionary journal!\n" RESET);
             // Add to session history
             sessionWords[sessionWordCount] = malloc(strlen(word) + 1);
             strcpy(sessionWords[sessionWordCount++], word);
@@ -635,7 +1666,7 @@ int main()
         case 2: // Search by prefix
             printf(GREY "Enter prefix: " RESET);
             scanf("%s", word);
-            toLowerCase(word);
+            foldCase(word);
             autoSuggest(root, word);
             break;
         case 3: // Display all words
@@ -648,11 +1679,12 @@ int main()
             showShortestLongestWord(root);
             break;
         case 6: // Delete a word
+            leaveSnapshotEngine(root);
             printf(GREY "Enter word to delete: " RESET);
             scanf("%s", word);
-            toLowerCase(word);
+            foldCase(word);
 
-            if (searchWord(root, word))
+            if (containsWord(root, word))
             {
                 // Confirmation prompt before deleting
                 char confirm;
@@ -703,8 +1735,9 @@ int main()
             {
                 // Get the last deleted word
                 char *wordToRestore = deletedSessionWords[--deletedSessionWordCount];
-                insert(root, wordToRestore);      // Add back to Trie
-                saveWordToFile(wordToRestore);  // Add back to file
+                insertWord(root, wordToRestore); // Add back to Trie
+                if (!saveWordToFile(wordToRestore)) // Add back to file
+                    printf(BOLDRED "Error opening dictionary journal!\n" RESET);
                 // Add back to "recently added" list
                 sessionWords[sessionWordCount] = malloc(strlen(wordToRestore) + 1);
                 strcpy(sessionWords[sessionWordCount++], wordToRestore);
@@ -716,19 +1749,77 @@ int main()
         case 9: // Show frequent searches
             showMostFrequentSearches();
             break;
-        case 10: // Exit
+        case 10: // Ranked suggestions from the per-node caches
+            if (getEngine() == ENGINE_RADIX)
+            {
+                printf(BOLDRED "Ranked suggestions are only available with the trie engine.\n" RESET);
+                break;
+            }
+            leaveSnapshotEngine(root); // The caches live in the Trie, not in the snapshot
+            printf(GREY "Enter prefix: " RESET);
+            scanf("%s", word);
+            foldCase(word);
+            showTopSuggestions(root, word);
+            break;
+        case 11: // Fold the journal into the dictionary file
+            if (compactDictionary(root))
+                printf(GREEN "Dictionary file compacted successfully!\n" RESET);
+            else
+                printf(BOLDRED "Error compacting dictionary file!\n" RESET);
+            break;
+        case 12: // Fuzzy suggestions, also from the per-node caches
+            if (getEngine() == ENGINE_RADIX)
+            {
+                printf(BOLDRED "Typo-tolerant suggestions are only available with the trie engine.\n" RESET);
+                break;
+            }
+            leaveSnapshotEngine(root);
+            printf(GREY "Enter prefix: " RESET);
+            scanf("%s", word);
+            foldCase(word);
+            int distance;
+            printf(GREY "Maximum number of typos (0-%d): " RESET, MAX_FUZZY_DISTANCE);
+            if (scanf("%d", &distance) != 1 || distance < 0 || distance > MAX_FUZZY_DISTANCE)
+                distance = FUZZY_DISTANCE;
+            getchar(); // Consume the newline character left by scanf
+            showFuzzySuggestions(root, word, distance);
+            break;
+        case 13: // Counters and latency percentiles
+            showMetrics();
+            break;
+        case 14: // Completions one page at a time
+            if (getEngine() == ENGINE_RADIX)
+            {
+                printf(BOLDRED "Paged suggestions are only available with the trie engine.\n" RESET);
+                break;
+            }
+            leaveSnapshotEngine(root); // The cursor walks the Trie
+            printf(GREY "Enter prefix: " RESET);
+            scanf("%s", word);
+            foldCase(word);
+            showCompletionPages(root, word);
+            getchar(); // Consume the newline character left by scanf
+            break;
+        case 15: // Infix search from the trigram index
+            printf(GREY "Enter part of a word: " RESET);
+            scanf("%s", word);
+            foldCase(word);
+            showSubstringMatches(root, word);
+            getchar(); // Consume the newline character left by scanf
+            break;
+        case 16: // Exit
             printf(BOLDYELLOW "PROGRAM EXITED SUCCESSFULLY.\n" RESET);
             saveSearchStats(); // Save search history before exiting
+            saveMetrics();     // Keep this session's metrics for later comparison
+            shutdownEngines(root, useSnapshot);
             // Clean up dynamically allocated memory
             for (int i = 0; i < sessionWordCount; i++)
                 free(sessionWords[i]);
             for (int i = 0; i < deletedSessionWordCount; i++)
                 free(deletedSessionWords[i]);
-            // (Note: A full Trie cleanup function would free all nodes, but is omitted here for simplicity)
             return 0;
         default:
             printf(BOLDRED "Invalid choice! Please try again.\n" RESET);
         }
     }
 }
-